@@ -9,6 +9,7 @@
 #define	BOUNDED_RACTANGLE_HPP
 
 #include "particle_policies.hpp"
+#include "particle_group.hpp"
 #include "particle_data_policies.hpp"
 #include "lifetime_evolution_policies.hpp"
 #include "space_evolution_policies.hpp"
@@ -17,51 +18,97 @@
 
 #include "../snippets/math_2d.h"
 
+#include <random>
+
 namespace cpp
 {
     namespace bounded
     {
+        //El color de cada partícula depende de su posición. Es puramente cosmético, así que se calcula al dibujar
+        //(Ver cpp::derived_color_drawing_policy), no en cada paso de la simulación:
+        struct position_color
+        {
+            sf::Color operator()( const cpp::default_particle_data_holder& data ) const
+            {
+                return sf::Color{ (sf::Uint8)( (int)data.position().x % 256 ) , 
+                                  (sf::Uint8)( (int)data.position().y % 256 ) , 
+                                  (sf::Uint8)( (int)data.position().y % 256 ) };
+            }
+        };
         
-        struct bounded_engine : public cpp::basic_particle_engine
+        //PARTICLE_DATA es el formato en el que se guardan las partículas: Con cpp::compact_particle_data_holder ocupan 14 bytes en vez de 20 
+        //(Las etapas del pipeline siguen trabajando con default_particle_data_holder, ver cpp::particle_group)
+        template<typename PARTICLE_DATA>
+        struct basic_bounded_engine : public cpp::basic_particle_engine
         {
             using obstacle_t = cpp::inverse_bounds<cpp::circle_bounds>;
             using bounds_t   = cpp::rectangle_bounds;
         
-            using particle = cpp::policied_particle<cpp::default_particle_data_holder,
-                                                    cpp::evolution_policies_pipeline<cpp::default_particle_data_holder>,
-                                                    cpp::pixel_particle_drawing_policy>;
+            //Todas las partículas siguen el mismo pipeline, así que lo guarda el grupo una sola vez. El estado que las
+            //etapas necesitan por partícula (Ver bounded_space_evolution_policy) se guarda en columnas junto a los datos:
+            using particle = PARTICLE_DATA;
+            using particles_group = cpp::particle_group<particle,
+                                                        cpp::evolution_policies_pipeline<cpp::default_particle_data_holder>,
+                                                        cpp::derived_color_drawing_policy<cpp::bounded::position_color>>;
         
             void initialize( std::size_t particles_count , const dl32::vector_2df& begin , float speed , const cpp::evolution_policies_pipeline<cpp::default_particle_data_holder>& pipeline )
             {
                 std::mt19937 prng;
                 std::uniform_real_distribution<float> dist{ 0.0f , 2.0f * 3.141592654f };
                 
+                //Las posiciones comprimidas son relativas al centro del sistema:
+                _groups.assign( 1u , particles_group{ pipeline , typename particles_group::drawing_policy_t{} , 
+                                                      data_format( begin , typename particles_group::is_packed{} ) } );
+                
+                auto& particles = _groups.front();
+                particles.reserve( particles_count );
+                
                 for( std::size_t i = 0 ; i < particles_count ; ++i )
                 {
                     float angle = dist( prng );
                     dl32::vector_2df particle_speed{ std::cos( angle ) * speed , std::sin( angle ) * speed };
                     
-                    _particles.emplace_back( typename particle::data_policy_t{ begin , particle_speed , sf::Color::White } ,
-                                             pipeline ,
-                                             typename particle::drawing_policy_t{} 
-                                           );
+                    particles.add( cpp::default_particle_data_holder{ begin , particle_speed , sf::Color::White } );
                 }
             }
                 
             template<typename CANVAS>
             void draw( CANVAS& canvas ) const
             {
-                cpp::basic_particle_engine::draw( _particles , cpp::pixel_particle_drawing_policy{} , canvas );
+                cpp::basic_particle_engine::draw( _groups , cpp::pixel_particle_drawing_policy{} , canvas );
             }
             
             void step()
             {
-                cpp::basic_particle_engine::step( _particles );
+                for( auto& group : _groups )
+                    group.step();
+            }
+            
+            //Reordenación espacial periódica de las partículas (Ver cpp::particle_group::reorder()):
+            void reorder_period( std::size_t frames )
+            {
+                for( auto& group : _groups )
+                    group.reorder_period( frames );
             }
                 
         private:
-            std::vector<particle> _particles;
+            using data_format_t = typename particles_group::data_format_t;
+            
+            static data_format_t data_format( const dl32::vector_2df& , tml::false_type )
+            {
+                return data_format_t{};
+            }
+            
+            static data_format_t data_format( const dl32::vector_2df& origin , tml::true_type )
+            {
+                return data_format_t{ origin };
+            }
+            
+            std::vector<particles_group> _groups;
         };
+        
+        using bounded_engine = basic_bounded_engine<cpp::default_particle_data_holder>;
+        using compact_bounded_engine = basic_bounded_engine<cpp::compact_particle_data_holder>;
     }
 }
 
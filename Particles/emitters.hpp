@@ -0,0 +1,343 @@
+/****************************************************************************
+* Snippets, ejemplos, y utilidades del curso de C++ orientado a videojuegos *
+* https://github.com/Manu343726/CppVideojuegos/                             *
+*                                                                           *
+* Copyright © 2014 Manuel Sánchez Pérez                                     *
+*                                                                           *
+* This program is free software. It comes without any warranty, to          *
+* the extent permitted by applicable law. You can redistribute it           *
+* and/or modify it under the terms of the Do What The Fuck You Want         *
+* To Public License, Version 2, as published by Sam Hocevar. See            *
+* http://www.wtfpl.net/  and the COPYING file for more details.             *
+****************************************************************************/
+
+#ifndef EMITTERS_HPP
+#define	EMITTERS_HPP
+
+#include <SFML/Graphics.hpp>
+
+#include "../snippets/math_2d.h"
+#include "../snippets/aabb_2d.h"
+#include "../snippets/thread_pool.hpp"
+#include "../snippets/slot_map.hpp"
+
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace cpp
+{
+    //Los emisores y las partículas del pool se identifican con handles (Ver cpp::slot_map): Siguen valiendo aunque el pool 
+    //se compacte, y se puede comprobar si lo que señalan sigue vivo.
+    using emitter_handle  = cpp::slot_handle;
+    using particle_handle = cpp::slot_handle;
+
+    /* Un emisor describe una explosión de partículas: Cuántas salen, cómo salen, y cómo viven. Las partículas pasan por tres
+     * fases como las de los fuegos artificiales (Ver cpp::fireworks::firework_lifetime_policy), cada una con su color.
+     *
+     * Los emisores forman una jerarquía: Cuando muere una de cada child_stride partículas de un emisor, en el punto donde ha
+     * muerto se lanza una explosión del emisor child (Un cohete que explota, chispas que vuelven a explotar, etc).
+     */
+    struct emitter
+    {
+        std::size_t burst  = 100;  //Partículas por explosión
+        std::size_t budget = 1000; //Máximo de partículas del emisor vivas a la vez (Lo que se pasa no se lanza)
+
+        int   lifetime = 1000;     //Frames que vive cada partícula
+        float speed    = 0.01f;    //Velocidad de salida
+        float spread   = 0.0f;     //Variación aleatoria de la velocidad de salida (Fracción de speed)
+        float angle    = 0.0f;     //Dirección de salida (Radianes)...
+        float cone     = 2.0f * 3.141592654f; //...y apertura del abanico de direcciones
+
+        dl32::vector_2df gravity;  //Aceleración constante
+
+        float grow = 1.0f , degrow = 1.0f;         //Aceleración en la primera fase de la vida, y frenado en la última
+        float end_child = 0.3f , end_adult = 0.6f; //Fin de la primera y la segunda fase (Fracción de la vida)
+
+        sf::Color colors[3] = { sf::Color::Red , sf::Color::Green , sf::Color::Blue };
+
+        cpp::emitter_handle child; //Por defecto ninguno
+        std::size_t child_stride = 1;
+
+        //Emisores raíz: Se lanzan solos cada period frames, en un punto aleatorio del área del pool (0 es nunca, ver launch())
+        std::size_t period = 0;
+    };
+
+    /* Todas las partículas de todos los emisores salen del mismo pool, que se reserva entero al construirlo: Las vivas están
+     * al principio, contiguas, y al morir se compactan. Lanzar explosiones o matar partículas nunca reserva memoria durante
+     * un frame, aunque haya miles de fuegos artificiales a la vez. Si no queda sitio (En el pool o en el presupuesto del
+     * emisor), la explosión sale con menos partículas.
+     *
+     * El paso de las partículas se reparte entre los hilos (Ver cpp::thread_pool). Las muertes se cuentan por hilo, y sólo si
+     * hay alguna se recorre el pool para compactarlo y encolar las explosiones hijas.
+     *
+     * Tanto las partículas como los emisores se guardan en slot maps, así que fuera del pool se les puede seguir la pista con
+     * handles (Una cámara que sigue a un cohete, por ejemplo) aunque las muertes los muevan de sitio.
+     */
+    class emitter_pool
+    {
+    public:
+        struct particle
+        {
+            dl32::vector_2df position , speed;
+            int life_ahead;
+            cpp::emitter_handle emitter;
+            bool spawns_child;
+        };
+
+        emitter_pool( std::size_t capacity , const cpp::aabb_2d<float>& area , unsigned int seed = std::random_device{}() ) :
+            _capacity( capacity ) ,
+            _area( area ) ,
+            _prng{ seed } ,
+            _deaths( cpp::thread_pool::global().size() )
+        {
+            _particles.reserve( capacity );
+            
+            //Como mucho muere todo el pool en un frame, más los lanzamientos de los emisores raíz y los manuales:
+            _launches.reserve( capacity + launch_slack );
+            _vertices.reserve( capacity );
+        }
+
+        //Los emisores se añaden y se quitan al preparar el sistema, no durante un frame:
+        cpp::emitter_handle add_emitter( const cpp::emitter& emitter )
+        {
+            _launches.reserve( _capacity + _emitters.size() + 1 + launch_slack );
+
+            return _emitters.insert( emitter_entry{ emitter , 0 , 0 } );
+        }
+
+        //Sus partículas mueren con él, y los emisores que lo tenían como hijo ya no lanzan nada:
+        bool remove_emitter( const cpp::emitter_handle& emitter )
+        {
+            if( !_emitters.contains( emitter ) )
+                return false;
+
+            for( std::size_t i = 0 ; i < _particles.size() ; )
+            {
+                if( ( _particles.begin() + i )->emitter == emitter )
+                    _particles.erase_at( i );
+                else
+                    ++i;
+            }
+
+            return _emitters.erase( emitter );
+        }
+
+        bool contains( const cpp::emitter_handle& emitter ) const
+        {
+            return _emitters.contains( emitter );
+        }
+
+        cpp::emitter& emitter( const cpp::emitter_handle& emitter )
+        {
+            return _emitters[emitter].emitter;
+        }
+
+        const cpp::emitter& emitter( const cpp::emitter_handle& emitter ) const
+        {
+            return _emitters[emitter].emitter;
+        }
+
+        //Lanza una explosión en el siguiente paso. Si la cola está llena no se lanza (Devuelve false):
+        bool launch( const cpp::emitter_handle& emitter , const dl32::vector_2df& position )
+        {
+            if( _launches.size() == _launches.capacity() )
+                return false;
+
+            _launches.push_back( launch_request{ emitter , position } );
+            return true;
+        }
+
+        void step()
+        {
+            ++_frame;
+
+            std::fill( std::begin( _deaths ) , std::end( _deaths ) , 0 );
+
+            cpp::thread_pool::global().parallel_for( _particles.size() , 1024u , [this]( std::size_t begin , std::size_t end )
+            {
+                std::size_t deaths = 0;
+
+                for( auto it = _particles.begin() + begin ; it != _particles.begin() + end ; ++it )
+                {
+                    auto& p = *it;
+                    const auto& e = _emitters[p.emitter].emitter;
+
+                    p.position += p.speed;
+
+                    float age = 1.0f - static_cast<float>( p.life_ahead ) / e.lifetime;
+
+                    if( age <= e.end_child )     p.speed *= e.grow;
+                    else if( age > e.end_adult ) p.speed *= e.degrow;
+
+                    p.speed += e.gravity;
+
+                    if( --p.life_ahead < 0 ) ++deaths;
+                }
+
+                _deaths[cpp::thread_pool::worker_index()] += deaths;
+            });
+
+            if( std::any_of( std::begin( _deaths ) , std::end( _deaths ) , []( std::size_t deaths ){ return deaths > 0; } ) )
+                bury();
+
+            for( std::size_t i = 0 ; i < _emitters.size() ; ++i )
+            {
+                const auto& e = ( _emitters.begin() + i )->emitter;
+
+                if( e.period > 0 && _frame % e.period == 0 )
+                {
+                    std::uniform_real_distribution<float> x{ _area.left() , _area.right() } , y{ _area.bottom() , _area.top() };
+
+                    launch( _emitters.handle_of( i ) , dl32::vector_2df{ x( _prng ) , y( _prng ) } );
+                }
+            }
+
+            for( auto& request : _launches )
+                emit( request.emitter , request.position );
+
+            _launches.clear();
+        }
+
+        template<typename CANVAS>
+        void draw( CANVAS& canvas ) const
+        {
+            _vertices.clear();
+
+            for( const auto& p : _particles )
+            {
+                const auto& e = _emitters[p.emitter].emitter;
+
+                float age = 1.0f - static_cast<float>( p.life_ahead ) / e.lifetime;
+
+                _vertices.emplace_back( sf::Vector2f{ p.position.x , p.position.y } ,
+                                        e.colors[age <= e.end_child ? 0 : age <= e.end_adult ? 1 : 2] );
+            }
+
+            canvas.draw( _vertices.data() , _vertices.size() , sf::Points );
+        }
+
+        //Partículas vivas (En total, y de un emisor):
+        std::size_t size() const
+        {
+            return _particles.size();
+        }
+
+        std::size_t alive( const cpp::emitter_handle& emitter ) const
+        {
+            return _emitters[emitter].alive;
+        }
+
+        std::size_t capacity() const
+        {
+            return _capacity;
+        }
+
+        //nullptr si la partícula ya ha muerto:
+        const particle* find( const cpp::particle_handle& particle ) const
+        {
+            return _particles.find( particle );
+        }
+
+        cpp::particle_handle handle_of( std::size_t index ) const
+        {
+            return _particles.handle_of( index );
+        }
+
+        typename cpp::slot_map<particle>::const_iterator begin() const
+        {
+            return _particles.begin();
+        }
+
+        typename cpp::slot_map<particle>::const_iterator end() const
+        {
+            return _particles.end();
+        }
+
+    private:
+        struct emitter_entry
+        {
+            cpp::emitter emitter;
+            std::size_t alive , emitted;
+        };
+
+        struct launch_request
+        {
+            cpp::emitter_handle emitter;
+            dl32::vector_2df position;
+        };
+
+        //Lanzamientos manuales por frame que caben en la cola aparte de las muertes y los emisores raíz:
+        static constexpr std::size_t launch_slack = 256;
+
+        //Quita las muertas (La última ocupa su sitio), y encola las explosiones que lanzan:
+        void bury()
+        {
+            for( std::size_t i = 0 ; i < _particles.size() ; )
+            {
+                const auto& p = *( _particles.begin() + i );
+
+                if( p.life_ahead >= 0 )
+                {
+                    ++i;
+                    continue;
+                }
+
+                auto& entry = _emitters[p.emitter];
+
+                entry.alive--;
+
+                if( p.spawns_child && entry.emitter.child )
+                    launch( entry.emitter.child , p.position );
+
+                _particles.erase_at( i );
+            }
+        }
+
+        void emit( const cpp::emitter_handle& emitter , const dl32::vector_2df& position )
+        {
+            //El emisor se ha quitado después de encolar la explosión:
+            if( !_emitters.contains( emitter ) )
+                return;
+
+            auto& entry = _emitters[emitter];
+            const auto& e = entry.emitter;
+
+            std::size_t budget = e.budget > entry.alive ? e.budget - entry.alive : 0 ,
+                        count  = std::min( { e.burst , budget , _capacity - _particles.size() } );
+
+            std::uniform_real_distribution<float> unit{ -0.5f , 0.5f };
+
+            for( std::size_t i = 0 ; i < count ; ++i )
+            {
+                float angle = e.angle + e.cone * unit( _prng ) ,
+                      speed = e.speed * ( 1.0f + 2.0f * e.spread * unit( _prng ) );
+
+                _particles.insert( particle{ position ,
+                                             dl32::vector_2df{ std::cos( angle ) * speed , std::sin( angle ) * speed } ,
+                                             e.lifetime ,
+                                             emitter ,
+                                             ++entry.emitted % std::max( e.child_stride , std::size_t{ 1 } ) == 0 } );
+            }
+
+            entry.alive += count;
+        }
+
+        cpp::slot_map<particle> _particles; //Reservado entero al construir el pool
+        std::size_t _capacity;
+
+        cpp::slot_map<emitter_entry> _emitters;
+        std::vector<launch_request> _launches;
+
+        cpp::aabb_2d<float> _area;
+        std::mt19937 _prng;
+        std::size_t _frame = 0;
+
+        std::vector<std::size_t> _deaths;            //Muertes del paso, por hilo
+        mutable std::vector<sf::Vertex> _vertices;
+    };
+}
+
+#endif	/* EMITTERS_HPP */
@@ -0,0 +1,417 @@
+/****************************************************************************
+* Snippets, ejemplos, y utilidades del curso de C++ orientado a videojuegos *
+* https://github.com/Manu343726/CppVideojuegos/                             *
+*                                                                           *
+* Copyright © 2014 Manuel Sánchez Pérez                                     *
+*                                                                           *
+* This program is free software. It comes without any warranty, to          *
+* the extent permitted by applicable law. You can redistribute it           *
+* and/or modify it under the terms of the Do What The Fuck You Want         *
+* To Public License, Version 2, as published by Sam Hocevar. See            *
+* http://www.wtfpl.net/  and the COPYING file for more details.             *
+****************************************************************************/
+
+#ifndef FIELD_EVOLUTION_POLICIES_HPP
+#define	FIELD_EVOLUTION_POLICIES_HPP
+
+#include "../snippets/aabb_2d.h"
+#include "../snippets/math_2d.h"
+#include "../snippets/thread_pool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#define CPP_VECTOR_FIELD_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace cpp
+{
+    /* Campo vectorial precalculado en una rejilla
+     *
+     * Turbulencias, atractores, viento... Calcular cada efecto de manera analítica para cada partícula en cada frame
+     * es caro, y el coste crece con el número de efectos. El campo suma todas sus fuentes una sola vez en los nodos de
+     * una rejilla, y las partículas sólo hacen una interpolación bilineal: El coste por partícula es el mismo con una
+     * fuente que con cien.
+     *
+     * Cada fuente tiene un área de influencia. Añadir, cambiar o quitar una fuente sólo marca como sucios los nodos de
+     * su área, y rebuild() recalcula sólo esos nodos (Las fuentes que no cambian no cuestan nada).
+     *
+     * Los nodos se guardan por columnas (Las x por un lado y las y por otro), para que el muestreo por lotes pueda
+     * interpolar cuatro partículas a la vez con SSE2 (Ver sample()). Sin SSE2 se usa la versión escalar.
+     */
+    class vector_field
+    {
+    public:
+        using source    = std::function<dl32::vector_2df(const dl32::vector_2df&)>;
+        using source_id = std::size_t;
+
+        //Una rejilla de columns x rows nodos que cubre area (Los nodos de los bordes están sobre los bordes del área):
+        vector_field( const cpp::aabb_2d<float>& area , std::size_t columns , std::size_t rows ) :
+            _area( area ) ,
+            _columns{ std::max<std::size_t>( columns , 2u ) } ,
+            _rows{ std::max<std::size_t>( rows , 2u ) } ,
+            _x( _columns * _rows , 0.0f ) ,
+            _y( _columns * _rows , 0.0f ) ,
+            _dirty( _columns * _rows , 0u ) ,
+            _is_dirty{ false }
+        {
+            _cell_width  = _area.width()  / ( _columns - 1 );
+            _cell_height = _area.height() / ( _rows - 1 );
+        }
+
+        const cpp::aabb_2d<float>& area() const
+        {
+            return _area;
+        }
+
+        std::size_t columns() const
+        {
+            return _columns;
+        }
+
+        std::size_t rows() const
+        {
+            return _rows;
+        }
+
+        //Una fuente que afecta a todo el campo:
+        source_id add_source( source function )
+        {
+            return add_source( std::move( function ) , _area );
+        }
+
+        //Una fuente que sólo afecta a los nodos dentro de influence:
+        source_id add_source( source function , const cpp::aabb_2d<float>& influence )
+        {
+            _sources.push_back( source_entry{ std::move( function ) , influence , true } );
+            mark_dirty( influence );
+
+            return _sources.size() - 1;
+        }
+
+        void update_source( source_id id , source function )
+        {
+            update_source( id , std::move( function ) , _sources[id].influence );
+        }
+
+        void update_source( source_id id , source function , const cpp::aabb_2d<float>& influence )
+        {
+            mark_dirty( _sources[id].influence );
+
+            _sources[id].function  = std::move( function );
+            _sources[id].influence = influence;
+
+            mark_dirty( influence );
+        }
+
+        void remove_source( source_id id )
+        {
+            mark_dirty( _sources[id].influence );
+
+            _sources[id].alive    = false;
+            _sources[id].function = nullptr;
+        }
+
+        bool dirty() const
+        {
+            return _is_dirty;
+        }
+
+        //Recalcula los nodos afectados por los cambios desde el último rebuild() (Todos, la primera vez):
+        void rebuild( cpp::thread_pool& pool = cpp::thread_pool::global() )
+        {
+            if( !_is_dirty )
+                return;
+
+            pool.parallel_for( _rows , 8u , [&]( std::size_t begin , std::size_t end )
+            {
+                for( std::size_t row = begin ; row < end ; ++row )
+                {
+                    for( std::size_t column = 0 ; column < _columns ; ++column )
+                    {
+                        std::size_t index = row * _columns + column;
+
+                        if( !_dirty[index] ) continue;
+
+                        dl32::vector_2df node = node_position( column , row ) , value;
+
+                        for( auto& s : _sources )
+                            if( s.alive && s.influence.belongs_to( node ) )
+                                value += s.function( node );
+
+                        _x[index] = value.x;
+                        _y[index] = value.y;
+                        _dirty[index] = 0u;
+                    }
+                }
+            });
+
+            _is_dirty = false;
+        }
+
+        dl32::vector_2df node_position( std::size_t column , std::size_t row ) const
+        {
+            return dl32::vector_2df{ _area.left() + column * _cell_width , _area.bottom() + row * _cell_height };
+        }
+
+        //Interpolación bilineal del campo en position (Fuera del área se usa el borde más cercano):
+        dl32::vector_2df sample( const dl32::vector_2df& position ) const
+        {
+            float gx = std::min( std::max( ( position.x - _area.left() )   / _cell_width  , 0.0f ) , static_cast<float>( _columns - 1 ) ) ,
+                  gy = std::min( std::max( ( position.y - _area.bottom() ) / _cell_height , 0.0f ) , static_cast<float>( _rows - 1 ) );
+
+            float cx = std::min( std::floor( gx ) , static_cast<float>( _columns - 2 ) ) ,
+                  cy = std::min( std::floor( gy ) , static_cast<float>( _rows - 2 ) );
+
+            float tx = gx - cx , ty = gy - cy;
+            std::size_t index = static_cast<std::size_t>( cy ) * _columns + static_cast<std::size_t>( cx );
+
+            auto lerp2 = [&]( const std::vector<float>& v )
+            {
+                float bottom = v[index]            + ( v[index + 1]            - v[index] )            * tx ,
+                      top    = v[index + _columns] + ( v[index + _columns + 1] - v[index + _columns] ) * tx;
+
+                return bottom + ( top - bottom ) * ty;
+            };
+
+            return dl32::vector_2df{ lerp2( _x ) , lerp2( _y ) };
+        }
+
+        //Muestreo por lotes: (out_x[i],out_y[i]) = sample( (x[i],y[i]) ). Con SSE2 se interpolan cuatro puntos a la vez
+        //(Los cuatro nodos de cada punto se leen uno a uno: SSE2 no tiene gather).
+        void sample( const float* x , const float* y , float* out_x , float* out_y , std::size_t count ) const
+        {
+            std::size_t i = 0;
+
+#if defined( CPP_VECTOR_FIELD_SSE2 )
+            const __m128 left   = _mm_set1_ps( _area.left() ) ,
+                         bottom = _mm_set1_ps( _area.bottom() ) ,
+                         inverse_width  = _mm_set1_ps( 1.0f / _cell_width ) ,
+                         inverse_height = _mm_set1_ps( 1.0f / _cell_height ) ,
+                         zero   = _mm_setzero_ps() ,
+                         max_gx = _mm_set1_ps( static_cast<float>( _columns - 1 ) ) ,
+                         max_gy = _mm_set1_ps( static_cast<float>( _rows - 1 ) ) ,
+                         max_cx = _mm_set1_ps( static_cast<float>( _columns - 2 ) ) ,
+                         max_cy = _mm_set1_ps( static_cast<float>( _rows - 2 ) );
+
+            for( ; i + 4 <= count ; i += 4 )
+            {
+                __m128 gx = _mm_min_ps( _mm_max_ps( _mm_mul_ps( _mm_sub_ps( _mm_loadu_ps( x + i ) , left )   , inverse_width )  , zero ) , max_gx ) ,
+                       gy = _mm_min_ps( _mm_max_ps( _mm_mul_ps( _mm_sub_ps( _mm_loadu_ps( y + i ) , bottom ) , inverse_height ) , zero ) , max_gy );
+
+                //gx y gy no son negativos, así que truncar es redondear hacia abajo:
+                __m128 cx = _mm_min_ps( _mm_cvtepi32_ps( _mm_cvttps_epi32( gx ) ) , max_cx ) ,
+                       cy = _mm_min_ps( _mm_cvtepi32_ps( _mm_cvttps_epi32( gy ) ) , max_cy );
+
+                __m128 tx = _mm_sub_ps( gx , cx ) ,
+                       ty = _mm_sub_ps( gy , cy );
+
+                alignas( 16 ) std::int32_t column[4] , row[4];
+                _mm_store_si128( reinterpret_cast<__m128i*>( column ) , _mm_cvttps_epi32( cx ) );
+                _mm_store_si128( reinterpret_cast<__m128i*>( row )    , _mm_cvttps_epi32( cy ) );
+
+                alignas( 16 ) float corners_x[4][4] , corners_y[4][4];
+
+                for( std::size_t lane = 0 ; lane < 4 ; ++lane )
+                {
+                    std::size_t index = static_cast<std::size_t>( row[lane] ) * _columns + static_cast<std::size_t>( column[lane] );
+
+                    corners_x[0][lane] = _x[index];
+                    corners_x[1][lane] = _x[index + 1];
+                    corners_x[2][lane] = _x[index + _columns];
+                    corners_x[3][lane] = _x[index + _columns + 1];
+                    corners_y[0][lane] = _y[index];
+                    corners_y[1][lane] = _y[index + 1];
+                    corners_y[2][lane] = _y[index + _columns];
+                    corners_y[3][lane] = _y[index + _columns + 1];
+                }
+
+                auto lerp = []( __m128 a , __m128 b , __m128 t )
+                {
+                    return _mm_add_ps( a , _mm_mul_ps( _mm_sub_ps( b , a ) , t ) );
+                };
+
+                auto lerp2 = [&]( const float (&c)[4][4] )
+                {
+                    return lerp( lerp( _mm_load_ps( c[0] ) , _mm_load_ps( c[1] ) , tx ) ,
+                                 lerp( _mm_load_ps( c[2] ) , _mm_load_ps( c[3] ) , tx ) , ty );
+                };
+
+                _mm_storeu_ps( out_x + i , lerp2( corners_x ) );
+                _mm_storeu_ps( out_y + i , lerp2( corners_y ) );
+            }
+#endif
+            for( ; i < count ; ++i )
+            {
+                dl32::vector_2df value = sample( dl32::vector_2df{ x[i] , y[i] } );
+
+                out_x[i] = value.x;
+                out_y[i] = value.y;
+            }
+        }
+
+    private:
+        struct source_entry
+        {
+            source function;
+            cpp::aabb_2d<float> influence;
+            bool alive;
+        };
+
+        void mark_dirty( const cpp::aabb_2d<float>& influence )
+        {
+            auto first_cell = []( float offset , float cell ){ return static_cast<std::ptrdiff_t>( std::ceil( offset / cell ) ); };
+            auto last_cell  = []( float offset , float cell ){ return static_cast<std::ptrdiff_t>( std::floor( offset / cell ) ); };
+
+            std::ptrdiff_t first_column = std::max<std::ptrdiff_t>( first_cell( influence.left()   - _area.left()   , _cell_width )  , 0 ) ,
+                           last_column  = std::min<std::ptrdiff_t>( last_cell ( influence.right()  - _area.left()   , _cell_width )  , _columns - 1 ) ,
+                           first_row    = std::max<std::ptrdiff_t>( first_cell( influence.bottom() - _area.bottom() , _cell_height ) , 0 ) ,
+                           last_row     = std::min<std::ptrdiff_t>( last_cell ( influence.top()    - _area.bottom() , _cell_height ) , _rows - 1 );
+
+            for( std::ptrdiff_t row = first_row ; row <= last_row ; ++row )
+                for( std::ptrdiff_t column = first_column ; column <= last_column ; ++column )
+                    _dirty[row * _columns + column] = 1u;
+
+            _is_dirty = true;
+        }
+
+        cpp::aabb_2d<float> _area;
+        std::size_t _columns , _rows;
+        float _cell_width , _cell_height;
+
+        std::vector<float> _x , _y;
+        std::vector<std::uint8_t> _dirty;
+        bool _is_dirty;
+
+        std::vector<source_entry> _sources;
+    };
+
+    //Algunas fuentes típicas:
+    namespace field_sources
+    {
+        //Atracción hacia center, que se desvanece linealmente hasta radius (Con strength negativa repele):
+        inline cpp::vector_field::source attractor( const dl32::vector_2df& center , float strength , float radius )
+        {
+            return [=]( const dl32::vector_2df& point )
+            {
+                dl32::vector_2df direction = center - point;
+                float distance = direction.length();
+
+                if( distance >= radius || distance == 0.0f )
+                    return dl32::vector_2df{};
+
+                return direction * ( strength * ( 1.0f - distance / radius ) / distance );
+            };
+        }
+
+        //Viento: Una fuerza constante (Normalmente con un área de influencia limitada):
+        inline cpp::vector_field::source wind( const dl32::vector_2df& force )
+        {
+            return [=]( const dl32::vector_2df& )
+            {
+                return force;
+            };
+        }
+
+        //Turbulencia: El rotacional de un ruido de valor (Value noise) de periodo scale. Al ser un rotacional, el campo no
+        //tiene divergencia: Las partículas forman remolinos en lugar de acumularse en unos puntos concretos.
+        inline cpp::vector_field::source turbulence( float scale , float strength , std::uint32_t seed = 0u )
+        {
+            auto hash = [=]( std::int32_t x , std::int32_t y )
+            {
+                std::uint32_t h = static_cast<std::uint32_t>( x ) * 0x8DA6B343u ^ static_cast<std::uint32_t>( y ) * 0xD8163841u ^ seed * 0xCB1AB31Fu;
+                h = ( h ^ ( h >> 13 ) ) * 0x5BD1E995u;
+
+                return static_cast<float>( ( h ^ ( h >> 15 ) ) & 0xFFFFu ) / 65535.0f;
+            };
+
+            auto noise = [=]( float x , float y )
+            {
+                float fx = std::floor( x ) , fy = std::floor( y );
+                std::int32_t ix = static_cast<std::int32_t>( fx ) , iy = static_cast<std::int32_t>( fy );
+                float tx = x - fx , ty = y - fy;
+
+                tx = tx * tx * ( 3.0f - 2.0f * tx );
+                ty = ty * ty * ( 3.0f - 2.0f * ty );
+
+                float bottom = hash( ix , iy )     + ( hash( ix + 1 , iy )     - hash( ix , iy ) )     * tx ,
+                      top    = hash( ix , iy + 1 ) + ( hash( ix + 1 , iy + 1 ) - hash( ix , iy + 1 ) ) * tx;
+
+                return bottom + ( top - bottom ) * ty;
+            };
+
+            return [=]( const dl32::vector_2df& point )
+            {
+                const float h = 0.01f;
+                float x = point.x / scale , y = point.y / scale;
+
+                float dx = ( noise( x + h , y ) - noise( x - h , y ) ) / ( 2.0f * h ) ,
+                      dy = ( noise( x , y + h ) - noise( x , y - h ) ) / ( 2.0f * h );
+
+                return dl32::vector_2df{ dy , -dx } * strength;
+            };
+        }
+    }
+
+    /* Política que acelera las partículas según un campo vectorial. El campo se comparte (Varias políticas, o varias
+     * etapas de distintos pipelines pueden usar el mismo), y quien lo modifica es responsable de llamar a rebuild().
+     *
+     * La versión de grupo (Que también usan las etapas de un pipeline, bloque a bloque) muestrea el campo por lotes.
+     */
+    class vector_field_policy
+    {
+    public:
+        vector_field_policy( std::shared_ptr<const cpp::vector_field> field , float scale = 1.0f ) :
+            _field{ std::move( field ) } ,
+            _scale{ scale }
+        {}
+
+        const cpp::vector_field& field() const
+        {
+            return *_field;
+        }
+
+        template<typename PARTICLE_DATA>
+        void operator()( PARTICLE_DATA& data ) const
+        {
+            data.speed() += _field->sample( data.position() ) * _scale;
+        }
+
+        template<typename ITERATOR>
+        void operator()( ITERATOR first , ITERATOR last ) const
+        {
+            static const std::size_t batch = 256u;
+
+            float x[batch] , y[batch] , force_x[batch] , force_y[batch];
+
+            while( first != last )
+            {
+                std::size_t count = 0;
+                ITERATOR begin = first;
+
+                for( ; first != last && count < batch ; ++first , ++count )
+                {
+                    x[count] = first->position().x;
+                    y[count] = first->position().y;
+                }
+
+                _field->sample( x , y , force_x , force_y , count );
+
+                for( std::size_t i = 0 ; i < count ; ++i , ++begin )
+                    begin->speed() += dl32::vector_2df{ force_x[i] , force_y[i] } * _scale;
+            }
+        }
+
+    private:
+        std::shared_ptr<const cpp::vector_field> _field;
+        float _scale;
+    };
+}
+
+#endif	/* FIELD_EVOLUTION_POLICIES_HPP */
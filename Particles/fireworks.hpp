@@ -15,16 +15,19 @@
 #define	FIREWORKS_HPP
 
 #include "particle_policies.hpp"
+#include "particle_group.hpp"
 #include "particle_data_policies.hpp"
 #include "lifetime_evolution_policies.hpp"
 #include "space_evolution_policies.hpp"
 #include "particle_drawing_policies.hpp"
+#include "emitters.hpp"
 
 #include "../snippets/math_2d.h"
 #include "particle_evolution_policies.hpp"
 
 #include <random>
 #include <iostream>
+#include <cstdint>
 
 using namespace std::placeholders;
 
@@ -38,10 +41,18 @@ namespace cpp
         private:
             dl32::vector_2df begin;
             float init_speed , grow , degrow;
+            float end_child , end_adult;
+            int waves_left; //Oleadas que quedan después de la actual (Negativo si no se acaban nunca)
             
             std::mt19937 prng;
             std::uniform_real_distribution<float> dist;
             
+            //Las direcciones de salida de las partículas del grupo salen de un hash de su índice (Ver direction()), y en cada
+            //oleada se rotan todas un mismo ángulo aleatorio. El ángulo se sortea al preparar la oleada, no al procesar las 
+            //partículas, así que el PRNG sólo se toca desde un hilo:
+            std::uint32_t seed;
+            dl32::vector_2df rotation;
+            
             using birth_policy_type = cpp::particle_birth_action<DATA>;
             using life_policy_type  = cpp::segmented_life_policy<DATA>;
             using death_policy_type = cpp::particle_death_action<DATA>;
@@ -49,15 +60,17 @@ namespace cpp
             
         public:
             
+            //Con waves > 0, el equipo sólo explota ese número de veces: Después de la última muerte la política se queda inactiva
+            //(Ver cpp::lifetime_policy::idle()), y el grupo duerme las partículas, que ya no se mueven. Con 0 no para nunca.
             firework_lifetime_policy( int lifetime , const dl32::vector_2df begin_ , float speed , float grow_ , float degrow_ ,
-                                      float end_child = 0.3f , float end_adult = 0.6f) :
+                                      float end_child_ = 0.3f , float end_adult_ = 0.6f , int waves = 0 ) :
                 lifetime_policy_type //Inicializamos la política subyacente (tiempo de vida, políticas de nacimiento, vida, y muerte)
                 {
                     lifetime , 
                     birth_policy_type{ std::bind( &firework_lifetime_policy::birth_policy , std::ref( *this ) , _1 ) } ,
                     life_policy_type{ cpp::build_segmented_policy<DATA>() //Python, haha!
-                                      ( end_child , &firework_lifetime_policy::first_phase_life_policy  , *this ) //Una vez más confirmamos que los punteros a funciones miembro SON UNA PUTA MIERDA
-                                      ( end_adult , &firework_lifetime_policy::second_phase_life_policy , *this )
+                                      ( end_child_ , &firework_lifetime_policy::first_phase_life_policy  , *this ) //Una vez más confirmamos que los punteros a funciones miembro SON UNA PUTA MIERDA
+                                      ( end_adult_ , &firework_lifetime_policy::second_phase_life_policy , *this )
                                       ( 1.0f      , &firework_lifetime_policy::third_phase_life_policy  , *this )
                                     } ,
                     death_policy_type{ std::bind( &firework_lifetime_policy::death_policy , std::ref( *this ) , _1 ) }
@@ -67,8 +80,21 @@ namespace cpp
                 prng{ std::random_device{}() } ,
                 dist{ 0.0f , 2.0f*3.141592654f } ,
                 grow{ grow_ } ,
-                degrow{ degrow_ }
-            {}   
+                degrow{ degrow_ } ,
+                end_child{ end_child_ } ,
+                end_adult{ end_adult_ } ,
+                waves_left{ waves > 0 ? waves - 1 : -1 }
+            {
+                seed = prng();
+                rotate();
+            }
+            
+            //Lo único que escribe la política al procesar las partículas del grupo: Si la oleada ha terminado. Cada hilo tiene
+            //el suyo (Ver cpp::has_sharded_state), y se juntan en merge() antes del paso global:
+            struct shard_type
+            {
+                bool wave_ended = false;
+            };
                  
                 
                 
@@ -76,6 +102,9 @@ namespace cpp
             //Políticas de evolución de las partículas:    
                 
             
+            //Nótese que ninguna de ellas toca el color de las partículas: El color depende sólo de la fase de la vida
+            //en la que está el equipo, así que se calcula al dibujar (Ver phase_color() más abajo).
+            
             //Al nacer se posicionan en el centro con una diracción de salida aleatoria.
             //La idea es que si la distribución es uniforme (Que lo es, véase el PRNG y distribución usados)
             //parecerá una explosión circular:
@@ -87,140 +116,329 @@ namespace cpp
                 
                 particle_data.position() = begin;
                 particle_data.speed() = { std::cos( angle ) * init_speed , std::sin( angle ) * init_speed };
-                particle_data.color() = sf::Color::White;
             }
             
-            //Al morir se vuelvem magenta:
+            //Al morir se paran (Y se vuelven magenta, ver phase_color()):
             void death_policy( DATA& particle_data )
             {
                 //std::cout << "A particle is dying..." << std::endl;
                 
-                particle_data.color() = sf::Color::Magenta;
-                
                 //Siento si soy brusco, pero: QUIEN PONGA UN IF AQUÍ PARA NO MULTIPLICAR TODO EL RATO UNA VEZ QUE LA
                 //PARTÍCULA MUERTA HA PARADO NO TIENE NI PUTA IDEA NI DE PROGRAMAR NI DE COMO FUNCIONA EL HARDWARE HOY EN DÍA
                 particle_data.speed() *= 0.0f; //Los muertos no se mueven!
                 
-                this->respawn();
-                 
-                std::uniform_real_distribution<float> dist_x{ 100.0f , 700.0f } , dist_y{ 100.0f , 500.0f };
+                //La siguiente oleada se prepara una sola vez, no una vez por partícula muerta:
+                if( !this->is_respawn_pending() )
+                    next_wave();
+            }
+            
+            
+            
+            //Políticas de evolución del grupo:
+            
+            //Se llaman una sola vez por oleada (Transición del ciclo de vida), no una vez por partícula. El trabajo
+            //sobre las partículas se reduce a escrituras en bloque sobre el rango.
+            
+            //index es la posición de *first en el grupo:
+            template<typename ITERATOR>
+            void wave_birth( ITERATOR first , ITERATOR last , std::size_t index ) const
+            {
+                for( auto it = first ; it != last ; ++it , ++index )
+                {
+                    auto d = direction( index );
+                    
+                    it->position() = begin;
+                    it->speed()    = { d.x * rotation.x - d.y * rotation.y , d.x * rotation.y + d.y * rotation.x };
+                }
+            }
+            
+            template<typename ITERATOR>
+            void wave_death( ITERATOR first , ITERATOR last ) const
+            {
+                for( auto it = first ; it != last ; ++it )
+                    it->speed() *= 0.0f;
+            }
+            
+            //Ejecución de la política sobre un trozo del grupo de partículas que la comparten. Sólo escribe en las partículas
+            //y en shard, así que varios hilos pueden procesar trozos distintos a la vez:
+            template<typename ITERATOR>
+            void operator()( ITERATOR first , ITERATOR last , std::size_t index , shard_type& shard )
+            {
+                if( this->is_birth_frame() ) wave_birth( first , last , index );
                 
-                begin.x = dist_x( prng );
-                begin.y = dist_y( prng );
+                this->live( first , last );
+                
+                if( this->is_death_frame() )
+                {
+                    wave_death( first , last );
+                    shard.wave_ended = true;
+                }
+            }
+            
+            //La siguiente oleada se prepara una sola vez, aunque la muerte la hayan visto todos los hilos:
+            template<typename SHARDS>
+            void merge( SHARDS& shards )
+            {
+                bool wave_ended = false;
+                
+                for( auto& shard : shards )
+                {
+                    wave_ended = wave_ended || shard.wave_ended;
+                    shard.wave_ended = false;
+                }
+                
+                if( wave_ended ) next_wave();
             }
             
-            //Cuando son "niñas" (Primer tercio de su vida) son rojas:
+            //Ejecución de la política sobre el grupo entero de partículas que la comparten:
+            template<typename ITERATOR>
+            void operator()( ITERATOR first , ITERATOR last )
+            {
+                shard_type shard;
+                
+                (*this)( first , last , 0 , shard );
+                
+                if( shard.wave_ended ) next_wave();
+            }
+            
+            using lifetime_policy_type::operator();
+            
+            //Cuando son "niñas" (Primer tercio de su vida) aceleran:
             void first_phase_life_policy( DATA& particle_data , float age ) const
             {
                 //std::cout << "A child particle!" << std::endl;
                 
-                particle_data.color() = sf::Color::Red;
-                
                 particle_data.speed() *= grow; //Los niños son muy acelarados...
             }
             
-            //Cuando son "adultas" (Segundo tercio de su vida) son verdes:
-            void second_phase_life_policy( DATA& particle_data , float age ) const
+            //Cuando son "adultas" (Segundo tercio de su vida) mantienen su velocidad:
+            void second_phase_life_policy( DATA& , float age ) const
             {
                 //std::cout << "An adult particle" << std::endl;
-                
-                particle_data.color() = sf::Color::Green;
             }
             
-            //Cuando son "ancianas" (Tercer tercio de su vida) son azules:
+            //Cuando son "ancianas" (Tercer tercio de su vida) frenan:
             void third_phase_life_policy( DATA& particle_data , float age ) const
             {
                 //std::cout << "I'm a pretty old particle..." << std::endl;
                 
-                particle_data.color() = sf::Color::Blue;
-                
                 particle_data.speed() *= degrow; //Los mayores cada vez van más despacio...
             }
+            
+            //Color de las partículas del equipo según la fase de su vida. Lo usa la política de dibujo (Ver phase_color más abajo),
+            //así que sólo se calcula cuando se dibuja un frame:
+            sf::Color phase_color() const
+            {
+                //Acaban de morir (Renacen en el siguiente paso):
+                if( this->is_birth_frame() || !this->is_alive() ) return sf::Color::Magenta;
+                
+                float age = this->age();
+                
+                if( age <= end_child ) return sf::Color::Red;
+                if( age <= end_adult ) return sf::Color::Green;
+                
+                return sf::Color::Blue;
+            }
+            
+        private:
+            //Renacimiento en una nueva posición aleatoria (Si quedan oleadas):
+            void next_wave()
+            {
+                if( waves_left == 0 )
+                    return;
+                
+                if( waves_left > 0 )
+                    waves_left--;
+                
+                this->respawn();
+                 
+                std::uniform_real_distribution<float> dist_x{ 100.0f , 700.0f } , dist_y{ 100.0f , 500.0f };
+                
+                begin.x = dist_x( prng );
+                begin.y = dist_y( prng );
+                
+                rotate();
+            }
+            
+            //Un único sorteo por oleada: La rotación del abanico de direcciones (Ya escalada por la velocidad de salida)
+            void rotate()
+            {
+                float angle = dist( prng );
+                
+                rotation = { std::cos( angle ) * init_speed , std::sin( angle ) * init_speed };
+            }
+            
+            //Dirección de salida (unitaria) de la partícula index del grupo. Es un hash del índice, así que no hay que 
+            //guardarla ni sortearla:
+            dl32::vector_2df direction( std::size_t index ) const
+            {
+                std::uint32_t h = static_cast<std::uint32_t>( index ) * 0x9E3779B9u ^ seed;
+                
+                h ^= h >> 16; h *= 0x85EBCA6Bu;
+                h ^= h >> 13; h *= 0xC2B2AE35u;
+                h ^= h >> 16;
+                
+                float angle = h * ( 2.0f * 3.141592654f / 4294967296.0f );
+                
+                return { std::cos( angle ) , std::sin( angle ) };
+            }
         };
         
         using lifetime_policy = cpp::fireworks::firework_lifetime_policy<cpp::default_particle_data_holder>;
         using shared_lifetime_policy = cpp::shared_policy<cpp::fireworks::lifetime_policy>;
         
-        //Una partícula de nuestro sistema de fuegos artificiales es una partícula que usa como política la política
-        //del sistema de fuegos artificiales (Valga la redundancia...):
-        struct particle : public cpp::policied_particle<cpp::default_particle_data_holder,
-                                                        cpp::fireworks::shared_lifetime_policy,
-                                                        cpp::pixel_particle_drawing_policy>
+        //Una partícula de nuestro sistema de fuegos artificiales son solo sus datos: La política la comparten todas
+        //las partículas de un equipo, así que la guarda el equipo (Grupo de partículas), no cada partícula:
+        using particle = cpp::default_particle_data_holder;
+        
+        //Todas las partículas de un equipo tienen el color de la fase en la que está el equipo:
+        struct phase_color
         {
-            using base = cpp::policied_particle<cpp::default_particle_data_holder,
-                                                        cpp::fireworks::shared_lifetime_policy,
-                                                        cpp::pixel_particle_drawing_policy>;
+            shared_lifetime_policy policy;
             
-        
+            sf::Color operator()( const particle& ) const
+            {
+                return policy->phase_color();
+            }
             
-            particle( const cpp::fireworks::shared_lifetime_policy& policy ) :
-                base
-                {
-                    cpp::default_particle_data_holder{} , //Inicializamos los datos de la partícula por defecto
-                                                          //Al fin y al cabo se van a "inicializar" cuando nazcan 
-                                                          //(Ver políticas de evolución más arriba)
-                    policy ,
-                    cpp::pixel_particle_drawing_policy{}
-                }
-            {}
+            //El color no depende de la partícula: Cambia cuando cambia el del equipo
+            std::uint64_t generation() const
+            {
+                sf::Color color = policy->phase_color();
+                
+                return ( static_cast<std::uint64_t>( color.r ) << 24 ) | ( static_cast<std::uint64_t>( color.g ) << 16 ) | 
+                       ( static_cast<std::uint64_t>( color.b ) << 8 ) | color.a;
+            }
         };
         
+        using team = cpp::particle_group<cpp::fireworks::particle,
+                                         cpp::fireworks::shared_lifetime_policy,
+                                         cpp::derived_color_drawing_policy<cpp::fireworks::phase_color>>;
+        
         
         //Y finalmente el motor del sistema de "fuegos artificiales":
         struct fireworks_engine : public cpp::basic_particle_engine
         {
         private:
-            std::vector<cpp::fireworks::particle> particles_; //Conjunto de partículas
-            
-            //Política de evolución de las partículas:
+            std::vector<cpp::fireworks::team> teams_; //Conjunto de partículas, agrupadas por la política que siguen
             
-            shared_lifetime_policy particles_lifetime_policy , team_a , team_b , team_c; 
+            void add_team( const shared_lifetime_policy& policy , std::size_t count )
+            {
+                teams_.emplace_back( policy , cpp::make_derived_color_drawing_policy( phase_color{ policy } ) );
+                
+                //Inicializamos los datos de las partículas por defecto. Al fin y al cabo se van a "inicializar" cuando nazcan 
+                //(Ver políticas de evolución más arriba)
+                teams_.back().add( cpp::fireworks::particle{} , count );
+            }
             
             
         public:
-            fireworks_engine( int lifetime , const dl32::vector_2df& center , float speed ) :
-                particles_lifetime_policy{ std::make_shared<lifetime_policy>( lifetime , center , speed , 1.0003f , 0.9997f ) } ,
-                team_a{ std::make_shared<lifetime_policy>( lifetime , center                                   , speed      , 1.0003f , 0.9998f , 0.3f  , 0.6f  ) } ,
-                team_b{ std::make_shared<lifetime_policy>( lifetime , center + dl32::vector_2df{ 1.0f , 1.0f } , speed*1.0f , 1.0006f , 0.9997f , 0.2f  , 0.24f ) } ,
-                team_c{ std::make_shared<lifetime_policy>( lifetime , center - dl32::vector_2df{ 1.0f , 1.0f } , speed*1.1f , 1.003f  , 0.9992f , 0.04f , 0.5f  ) }
+            //Con waves > 0 los equipos explotan ese número de veces, y después se quedan parados (Y dormidos, ver firework_lifetime_policy):
+            fireworks_engine( int lifetime , const dl32::vector_2df& center , float speed , int waves = 0 )
             {
+                teams_.reserve( 4u );
                 
-                //Las partículas guardan una referencia a la política de evolución que siguen:
-                cpp::fireworks::particle main_particle{ particles_lifetime_policy };
-                particles_.assign( 1000u , main_particle );       
+                add_team( std::make_shared<lifetime_policy>( lifetime , center , speed , 1.0003f , 0.9997f , 0.3f , 0.6f , waves ) , 1000u );
+                add_team( std::make_shared<lifetime_policy>( lifetime , center                                   , speed      , 1.0003f , 0.9998f , 0.3f  , 0.6f  , waves ) , 1000u );
+                add_team( std::make_shared<lifetime_policy>( lifetime , center + dl32::vector_2df{ 1.0f , 1.0f } , speed*1.0f , 1.0006f , 0.9997f , 0.2f  , 0.24f , waves ) , 1000u );
+                add_team( std::make_shared<lifetime_policy>( lifetime , center - dl32::vector_2df{ 1.0f , 1.0f } , speed*1.1f , 1.003f  , 0.9992f , 0.04f , 0.5f  , waves ) , 1000u );
+            }
+            
+            //Partículas dormidas de todos los equipos:
+            std::size_t sleeping() const
+            {
+                std::size_t count = 0;
                 
+                for( auto& team : teams_ )
+                    count += team.sleeping();
                 
+                return count;
+            }
                 
-                //Las partículas guardan una referencia a la política de evolución que siguen:
-                cpp::fireworks::particle team_a_particle{ team_a  };
-                particles_.insert( std::end( particles_ ) , 1000u , team_a_particle );   
                 
-                //Las partículas guardan una referencia a la política de evolución que siguen:
-                cpp::fireworks::particle team_b_particle{ team_b };
-                particles_.insert( std::end( particles_ ) , 1000u , team_b_particle );   
+            //No hay que ser un gurú de C++ para entender las dos funciones de debajo...
                 
-                //Las partículas guardan una referencia a la política de evolución que siguen:
-                cpp::fireworks::particle team_c_particle{ team_c };
-                particles_.insert( std::end( particles_ ) , 1000u , team_c_particle );            
+            template<typename CANVAS>
+            void draw( CANVAS& canvas ) const
+            {
+                cpp::basic_particle_engine::draw( teams_ , cpp::pixel_particle_drawing_policy{} , canvas );
+            }
+            
+            void step()
+            {
+                for( auto& team : teams_ )
+                    team.step();
             }
+        };
+        
+        
+        /* Los equipos de arriba son cuatro grupos fijos de partículas. Aquí los fuegos artificiales son una jerarquía de emisores
+         * (Ver cpp::emitter): Cohetes que suben y explotan, y parte de las chispas de cada explosión vuelven a explotar al morir.
+         * Todas las partículas salen del mismo pool (Ver cpp::emitter_pool), reservado de una vez al construir el motor.
+         */
+        struct fireworks_show : public cpp::basic_particle_engine
+        {
+        public:
+            fireworks_show( std::size_t capacity , const cpp::aabb_2d<float>& area ) :
+                _pool{ capacity , area }
+            {
+                cpp::emitter crackle;
+                crackle.burst     = 12;
+                crackle.budget    = capacity / 4;
+                crackle.lifetime  = 2000;
+                crackle.speed     = 0.004f;
+                crackle.spread    = 0.5f;
+                crackle.degrow    = 0.9995f;
+                crackle.colors[0] = sf::Color::White;
+                crackle.colors[1] = sf::Color::Yellow;
+                crackle.colors[2] = sf::Color::Magenta;
                 
+                cpp::emitter burst;
+                burst.burst        = 400;
+                burst.budget       = capacity / 2;
+                burst.lifetime     = 6000;
+                burst.speed        = 0.02f;
+                burst.spread       = 0.1f;
+                burst.grow         = 1.0003f;
+                burst.degrow       = 0.9997f;
+                burst.gravity      = dl32::vector_2df{ 0.0f , 0.000002f };
+                burst.child        = _pool.add_emitter( crackle );
+                burst.child_stride = 8;
                 
-            //No hay que ser un gurú de C++ para entender las dos funciones de debajo...
+                cpp::emitter rocket;
+                rocket.burst     = 1;
+                rocket.budget    = 64;
+                rocket.lifetime  = 3000;
+                rocket.speed     = 0.08f;
+                rocket.spread    = 0.2f;
+                rocket.angle     = -3.141592654f / 2.0f; //Hacia arriba (La y de la pantalla crece hacia abajo)
+                rocket.cone      = 0.5f;
+                rocket.degrow    = 0.9999f;
+                rocket.colors[0] = rocket.colors[1] = rocket.colors[2] = sf::Color::White;
+                rocket.child     = _pool.add_emitter( burst );
+                rocket.period    = 400;
                 
+                _pool.add_emitter( rocket );
+            }
+            
             template<typename CANVAS>
             void draw( CANVAS& canvas ) const
             {
-                cpp::basic_particle_engine::draw( particles_ , cpp::pixel_particle_drawing_policy{} , canvas );
+                _pool.draw( canvas );
             }
             
             void step()
             {
-                cpp::basic_particle_engine::step( particles_ , particles_lifetime_policy ,
-                                                         team_a ,
-                                                         team_b ,
-                                                         team_c 
-                                          );
+                _pool.step();
             }
+            
+            const cpp::emitter_pool& pool() const
+            {
+                return _pool;
+            }
+            
+        private:
+            cpp::emitter_pool _pool;
         };
     }
 }
@@ -0,0 +1,93 @@
+/****************************************************************************
+* Snippets, ejemplos, y utilidades del curso de C++ orientado a videojuegos *
+* https://github.com/Manu343726/CppVideojuegos/                             *
+*                                                                           *
+* Copyright © 2014 Manuel Sánchez Pérez                                     *
+*                                                                           *
+* This program is free software. It comes without any warranty, to          *
+* the extent permitted by applicable law. You can redistribute it           *
+* and/or modify it under the terms of the Do What The Fuck You Want         *
+* To Public License, Version 2, as published by Sam Hocevar. See            *
+* http://www.wtfpl.net/  and the COPYING file for more details.             *
+****************************************************************************/
+
+#ifndef FRAME_EXPORT_HPP
+#define	FRAME_EXPORT_HPP
+
+#include <SFML/Graphics.hpp>
+
+#include "../snippets/aabb_2d.h"
+#include "../snippets/shared_frame_ring.hpp"
+
+#include <algorithm>
+
+namespace cpp
+{
+    /* Canvas que en vez de dibujar escribe las partículas en el siguiente frame de un cpp::shared_frame_writer, para que
+     * otro proceso las dibuje o las analice (Ver shared_frame_ring.hpp). Los motores dibujan en él como en una ventana:
+     *
+     *     cpp::frame_export frame{ writer , area };
+     *     engine.draw( frame );
+     *     frame.publish();
+     *
+     * Las posiciones y los colores se escriben directamente en las columnas del segmento compartido, sin pasar por
+     * ningún buffer intermedio. Sólo se exporta lo que cae dentro de area (La "vista" del canvas, ver
+     * cpp::pixel_particle_drawing_policy), y si no caben todas las partículas el resto se descarta (Ver dropped()).
+     */
+    class frame_export
+    {
+    public:
+        frame_export( cpp::shared_frame_writer& writer , const cpp::aabb_2d<float>& area ) :
+            _writer( &writer ) ,
+            _frame( writer.begin_frame() ) ,
+            _area( area )
+        {}
+
+        //Mismo interfaz que sf::RenderTarget::draw(). Todo se exporta como puntos:
+        void draw( const sf::Vertex* vertices , std::size_t count , sf::PrimitiveType = sf::Points )
+        {
+            std::size_t first = _frame.size() , fit = std::min( count , _frame.capacity() - first );
+
+            for( std::size_t i = 0 ; i < fit ; ++i )
+            {
+                const sf::Vertex& vertex = vertices[i];
+
+                _frame.x()[first + i]      = vertex.position.x;
+                _frame.y()[first + i]      = vertex.position.y;
+                _frame.colors()[first + i] = cpp::rgba{ vertex.color.r , vertex.color.g , vertex.color.b , vertex.color.a };
+            }
+
+            _frame.resize( first + fit );
+            _dropped += count - fit;
+        }
+
+        const cpp::aabb_2d<float>& area() const
+        {
+            return _area;
+        }
+
+        std::size_t size() const
+        {
+            return _frame.size();
+        }
+
+        std::size_t dropped() const
+        {
+            return _dropped;
+        }
+
+        //Los lectores no ven el frame hasta que se publica:
+        void publish()
+        {
+            _writer->publish( _frame );
+        }
+
+    private:
+        cpp::shared_frame_writer* _writer;
+        cpp::shared_frame _frame;
+        cpp::aabb_2d<float> _area;
+        std::size_t _dropped = 0;
+    };
+}
+
+#endif	/* FRAME_EXPORT_HPP */
@@ -0,0 +1,368 @@
+/****************************************************************************
+* Snippets, ejemplos, y utilidades del curso de C++ orientado a videojuegos *
+* https://github.com/Manu343726/CppVideojuegos/                             *
+*                                                                           *
+* Copyright © 2014 Manuel Sánchez Pérez                                     *
+*                                                                           *
+* This program is free software. It comes without any warranty, to          *
+* the extent permitted by applicable law. You can redistribute it           *
+* and/or modify it under the terms of the Do What The Fuck You Want         *
+* To Public License, Version 2, as published by Sam Hocevar. See            *
+* http://www.wtfpl.net/  and the COPYING file for more details.             *
+****************************************************************************/
+
+#ifndef GRAVITY_EVOLUTION_POLICIES_HPP
+#define	GRAVITY_EVOLUTION_POLICIES_HPP
+
+#include "../snippets/math_2d.h"
+#include "../snippets/thread_pool.hpp"
+#include "../snippets/radix_sort.hpp"
+#include "../snippets/frame_arena.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace cpp
+{
+    /* Gravedad entre partículas (N cuerpos) con el algoritmo de Barnes-Hut
+     *
+     * Calcular la atracción de cada partícula con todas las demás es O(n^2): Con 100.000 partículas son 10^10
+     * interacciones por frame. Barnes-Hut agrupa las partículas en un quadtree, y las partículas lejanas se tratan
+     * como una sola masa situada en el centro de masas de su celda. Una celda de lado s a distancia d se aproxima si
+     * s / d < opening_angle, así que el coste baja a O(n log n). Con opening_angle = 0 el resultado es exacto (Y lento),
+     * y valores más altos son más rápidos y menos precisos (0.5 - 1.0 suele ser suficiente para que quede bien).
+     *
+     * El árbol se construye en cada paso:
+     *
+     *  1. Se cuantiza la posición de cada partícula dentro de la caja (Cuadrada) del sistema, y se ordenan las
+     *     partículas por su código de Morton (Ver cpp::morton_key() y cpp::parallel_radix_sort()). Ordenadas así, las
+     *     partículas de cada celda del quadtree son un rango contiguo.
+     *  2. Los primeros niveles del árbol se construyen en serie, y cada subárbol por debajo de ellos se construye en
+     *     paralelo en su propio vector de nodos. Después se juntan todos en un único vector.
+     *  3. La fuerza sobre cada partícula se evalúa en paralelo, recorriendo el árbol en el orden de Morton (Partículas
+     *     vecinas recorren casi los mismos nodos, así que la caché lo agradece).
+     *
+     * Es una política de grupo: Necesita ver todas las partículas a la vez, así que se usa como política de un
+     * cpp::particle_group, no como etapa de un pipeline (Las etapas se ejecutan bloque a bloque). Todas las partículas
+     * tienen masa 1, y la aceleración se suma directamente a la velocidad (Un paso es un frame).
+     */
+    class barnes_hut_gravity_policy
+    {
+    public:
+        barnes_hut_gravity_policy( float strength = 0.001f , float opening_angle = 0.5f , float softening = 2.0f ,
+                                   cpp::thread_pool& pool = cpp::thread_pool::global() ) :
+            _strength{ strength } ,
+            _opening_angle{ opening_angle } ,
+            _softening{ softening } ,
+            _pool{ &pool }
+        {}
+
+        //Constante de gravitación (Negativa para que las partículas se repelan):
+        float strength() const
+        {
+            return _strength;
+        }
+
+        void strength( float value )
+        {
+            _strength = value;
+        }
+
+        float opening_angle() const
+        {
+            return _opening_angle;
+        }
+
+        void opening_angle( float value )
+        {
+            _opening_angle = value;
+        }
+
+        //Distancia de suavizado: Evita que dos partículas muy cercanas se aceleren hasta el infinito
+        float softening() const
+        {
+            return _softening;
+        }
+
+        void softening( float value )
+        {
+            _softening = value;
+        }
+
+        //Nodos del árbol construido en el último paso (Para depurar y medir):
+        std::size_t tree_size() const
+        {
+            return _nodes.size();
+        }
+
+        template<typename ITERATOR>
+        void operator()( ITERATOR first , ITERATOR last )
+        {
+            std::size_t count = static_cast<std::size_t>( std::distance( first , last ) );
+
+            if( count < 2 )
+                return;
+
+            build_tree( first , count );
+
+            cpp::frame_vector<dl32::vector_2df> accelerations( count );
+
+            _pool->parallel_for( count , grain , [&]( std::size_t begin , std::size_t end )
+            {
+                for( std::size_t i = begin ; i < end ; ++i )
+                    accelerations[i] = acceleration( i ) * _strength;
+            });
+
+            //La partícula i del árbol es la _order[i] del rango:
+            _pool->parallel_for( count , grain , [&]( std::size_t begin , std::size_t end )
+            {
+                for( std::size_t i = begin ; i < end ; ++i )
+                    first[_order[i]].speed() += accelerations[i];
+            });
+        }
+
+    private:
+        static const std::size_t grain = 1024u;
+        static const std::uint32_t leaf_capacity = 8u;
+        static const unsigned int max_depth = 16u;    //Bits por eje del código de Morton
+        static const unsigned int split_depth = 3u;   //Hasta 64 subárboles construidos en paralelo
+
+        struct node
+        {
+            dl32::vector_2df center_of_mass;
+            float mass = 0.0f;
+            float size = 0.0f;
+            std::int32_t children[4] = { -1 , -1 , -1 , -1 };
+            std::uint32_t first = 0 , count = 0; //Partículas de una hoja (count == 0 en los nodos internos)
+        };
+
+        //Subárbol pendiente de construir: Su raíz ya tiene un hueco reservado en el árbol
+        struct subtree
+        {
+            std::uint32_t begin , end;
+            unsigned int depth;
+            float size;
+            std::int32_t root;
+            cpp::frame_vector<node> nodes;
+        };
+
+        template<typename ITERATOR>
+        void build_tree( ITERATOR first , std::size_t count )
+        {
+            //Los temporales del paso salen de la memoria del frame (Ver cpp::frame_arena):
+            cpp::frame_vector<dl32::vector_2df> positions( count );
+
+            for( std::size_t i = 0 ; i < count ; ++i )
+                positions[i] = first[i].position();
+
+            float left = positions.front().x , right = left , bottom = positions.front().y , top = bottom;
+
+            for( auto& position : positions )
+            {
+                left   = std::min( left   , position.x );
+                right  = std::max( right  , position.x );
+                bottom = std::min( bottom , position.y );
+                top    = std::max( top    , position.y );
+            }
+
+            //La raíz es cuadrada, así que las celdas de cada nivel también:
+            float size  = std::max( std::max( right - left , top - bottom ) , 1e-6f );
+            float scale = 65535.0f / size;
+
+            cpp::frame_vector<std::uint32_t> keys( count );
+
+            _pool->parallel_for( count , grain , [&]( std::size_t begin , std::size_t end )
+            {
+                for( std::size_t i = begin ; i < end ; ++i )
+                    keys[i] = cpp::morton_key( static_cast<std::uint16_t>( ( positions[i].x - left )   * scale ) ,
+                                               static_cast<std::uint16_t>( ( positions[i].y - bottom ) * scale ) );
+            });
+
+            cpp::parallel_radix_sort( keys , _order , *_pool );
+
+            _keys.resize( count );
+            _positions.resize( count );
+
+            for( std::size_t i = 0 ; i < count ; ++i )
+            {
+                _keys[i]      = keys[_order[i]];
+                _positions[i] = positions[_order[i]];
+            }
+
+            //Niveles superiores en serie, y los subárboles en paralelo:
+            cpp::frame_vector<subtree> subtrees;
+
+            _nodes.clear();
+            build( _nodes , 0u , static_cast<std::uint32_t>( count ) , 0u , size , &subtrees );
+
+            _pool->parallel_for( subtrees.size() , 1u , [&]( std::size_t begin , std::size_t end )
+            {
+                for( std::size_t i = begin ; i < end ; ++i )
+                    build( subtrees[i].nodes , subtrees[i].begin , subtrees[i].end , subtrees[i].depth , subtrees[i].size );
+            });
+
+            std::size_t top_nodes = _nodes.size();
+
+            //Cada subárbol se copia al final del árbol. Su raíz (El nodo 0 del subárbol) va al hueco reservado:
+            for( auto& tree : subtrees )
+            {
+                std::int32_t offset = static_cast<std::int32_t>( _nodes.size() ) - 1;
+
+                auto relocate = [&]( node n )
+                {
+                    //El nodo 0 es la raíz del subárbol, que no es hija de nadie:
+                    for( auto& child : n.children )
+                        if( child > 0 ) child += offset;
+
+                    return n;
+                };
+
+                _nodes[tree.root] = relocate( tree.nodes.front() );
+
+                for( std::size_t i = 1 ; i < tree.nodes.size() ; ++i )
+                    _nodes.push_back( relocate( tree.nodes[i] ) );
+            }
+
+            //Los nodos superiores se crearon en preorden: Recorriéndolos al revés los hijos van antes que los padres
+            for( std::size_t i = top_nodes ; i > 0 ; --i )
+            {
+                node& n = _nodes[i - 1];
+
+                if( n.count == 0 )
+                    summarize( n , _nodes );
+            }
+        }
+
+        //Construye el nodo de las partículas [begin,end), que están en una celda de lado size a profundidad depth. Si
+        //subtrees no es nulo, los nodos de profundidad split_depth se dejan pendientes para construirlos en paralelo.
+        template<typename NODES>
+        std::int32_t build( NODES& nodes , std::uint32_t begin , std::uint32_t end , unsigned int depth , float size ,
+                            cpp::frame_vector<subtree>* subtrees = nullptr ) const
+        {
+            std::int32_t index = static_cast<std::int32_t>( nodes.size() );
+            nodes.emplace_back();
+
+            node n;
+            n.size = size;
+
+            if( end - begin <= leaf_capacity || depth == max_depth )
+            {
+                n.first = begin;
+                n.count = end - begin;
+                n.mass  = static_cast<float>( n.count );
+
+                for( std::uint32_t i = begin ; i < end ; ++i )
+                    n.center_of_mass += _positions[i];
+
+                n.center_of_mass /= n.mass;
+            }
+            else if( subtrees && depth == split_depth )
+            {
+                subtrees->push_back( subtree{ begin , end , depth , size , index , {} } );
+                return index;
+            }
+            else
+            {
+                //Las claves están ordenadas y comparten los bits de los niveles superiores, así que el cuadrante
+                //(Los dos bits de este nivel) no decrece dentro del rango:
+                unsigned int shift = 2u * ( max_depth - 1u - depth );
+                std::uint32_t child_begin = begin;
+
+                for( std::uint32_t quadrant = 0 ; quadrant < 4 ; ++quadrant )
+                {
+                    std::uint32_t child_end = static_cast<std::uint32_t>( std::partition_point( _keys.begin() + child_begin , _keys.begin() + end ,
+                        [=]( std::uint32_t key ){ return ( ( key >> shift ) & 3u ) <= quadrant; } ) - _keys.begin() );
+
+                    if( child_end > child_begin )
+                        n.children[quadrant] = build( nodes , child_begin , child_end , depth + 1 , size * 0.5f , subtrees );
+
+                    child_begin = child_end;
+                }
+
+                if( !subtrees )
+                    summarize( n , nodes );
+            }
+
+            nodes[index] = n;
+            return index;
+        }
+
+        //Masa y centro de masas de un nodo interno a partir de sus hijos:
+        template<typename NODES>
+        static void summarize( node& n , const NODES& nodes )
+        {
+            n.mass = 0.0f;
+            n.center_of_mass = dl32::vector_2df{};
+
+            for( auto child : n.children )
+            {
+                if( child < 0 ) continue;
+
+                n.mass           += nodes[child].mass;
+                n.center_of_mass += nodes[child].center_of_mass * nodes[child].mass;
+            }
+
+            n.center_of_mass /= n.mass;
+        }
+
+        //Aceleración (Sin multiplicar por strength) de la partícula i (En orden de Morton):
+        dl32::vector_2df acceleration( std::size_t i ) const
+        {
+            const dl32::vector_2df position = _positions[i];
+            const float theta2 = _opening_angle * _opening_angle;
+            const float softening2 = _softening * _softening;
+
+            auto pull = [=]( const dl32::vector_2df& target , float mass )
+            {
+                dl32::vector_2df distance = target - position;
+                float inverse = 1.0f / std::sqrt( distance.x * distance.x + distance.y * distance.y + softening2 );
+
+                return distance * ( mass * inverse * inverse * inverse );
+            };
+
+            dl32::vector_2df result;
+
+            //Cada nivel apila como mucho 4 hijos:
+            std::int32_t stack[4 * ( max_depth + 1 )];
+            std::size_t stack_size = 0;
+
+            stack[stack_size++] = 0;
+
+            while( stack_size > 0 )
+            {
+                const node& n = _nodes[stack[--stack_size]];
+
+                dl32::vector_2df distance = n.center_of_mass - position;
+                float distance2 = distance.x * distance.x + distance.y * distance.y;
+
+                if( n.size * n.size < theta2 * distance2 )
+                    result += pull( n.center_of_mass , n.mass );
+                else if( n.count > 0 )
+                {
+                    for( std::uint32_t j = n.first ; j < n.first + n.count ; ++j )
+                        if( j != i ) result += pull( _positions[j] , 1.0f );
+                }
+                else
+                {
+                    for( auto child : n.children )
+                        if( child >= 0 ) stack[stack_size++] = child;
+                }
+            }
+
+            return result;
+        }
+
+        float _strength , _opening_angle , _softening;
+        cpp::thread_pool* _pool;
+
+        //Árbol del último paso: Nodos, y las partículas en orden de Morton
+        std::vector<node> _nodes;
+        std::vector<std::size_t> _order;
+        std::vector<std::uint32_t> _keys;
+        std::vector<dl32::vector_2df> _positions;
+    };
+}
+
+#endif	/* GRAVITY_EVOLUTION_POLICIES_HPP */
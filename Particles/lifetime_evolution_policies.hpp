@@ -18,10 +18,26 @@
 
 #include <functional>
 #include <map>
+#include <stdexcept>
 
 
 namespace cpp
 {    
+    //Aplica una acción de vida a un rango de partículas con la misma edad. La implementación genérica es un simple bucle,
+    //pero ciertas acciones (Ver segmented_life_policy) pueden hacer parte del trabajo una sola vez para todo el rango:
+    template<typename LIFE , typename ITERATOR>
+    void apply_life_action( LIFE& life , ITERATOR first , ITERATOR last , float age )
+    {
+        for( auto it = first ; it != last ; ++it )
+            life( *it , age );
+    }
+    
+    template<typename PARTICLE_DATA>
+    struct segmented_life_policy;
+    
+    template<typename PARTICLE_DATA , typename ITERATOR>
+    void apply_life_action( cpp::segmented_life_policy<PARTICLE_DATA>& life , ITERATOR first , ITERATOR last , float age );
+    
     /* Una partícula nace, vive, y muere: Tratamos esos tres aspectos de manera independiente. 
        Esta clase representa la política de evolución de una partícula como el agregado de las tres 
        políticas de nacimiento, vida, y muerte 
@@ -31,21 +47,37 @@ namespace cpp
     {
     private:
         int _life_ahead , _lifetime;
+        bool _respawn_pending;
         
         BIRTH birth;
         LIFE life;
         DEATH death;
         
     protected:
+        //El renacimiento no es inmediato: Se aplica en el siguiente paso global. Así todas las partículas que comparten
+        //la política ven el mismo frame de muerte, y en el frame siguiente todas ellas nacen a la vez.
         void respawn()
         {
-            _life_ahead = _lifetime;
+            _respawn_pending = true;
+        }
+        
+        bool is_respawn_pending() const
+        {
+            return _respawn_pending;
+        }
+        
+        //Ejecuta la política de vida sobre un grupo entero. La edad es la misma para todo el grupo, así que se calcula una sola vez:
+        template<typename ITERATOR>
+        void live( ITERATOR first , ITERATOR last )
+        {
+            if( _life_ahead > 0 ) cpp::apply_life_action( life , first , last , age() );
         }
         
     public:
         lifetime_policy( int lifetime = 0 , const BIRTH& birth_policy = BIRTH{} , const LIFE& life_policy = LIFE{} , const DEATH& death_policy = DEATH{} ) :
             _life_ahead{ lifetime } ,
             _lifetime{ lifetime } ,
+            _respawn_pending{ false } ,
             birth{ birth_policy } ,
             life{ life_policy } ,
             death{ death_policy }
@@ -61,17 +93,65 @@ namespace cpp
             return is_alive();
         }
         
+        //Muertas y sin renacimiento pendiente: La política no va a volver a tocar las partículas (Ver cpp::particle_group, 
+        //que duerme las que están paradas)
+        bool idle() const
+        {
+            return !is_alive() && !_respawn_pending;
+        }
+        
+        //Transiciones del ciclo de vida. Como el tiempo de vida está en la política (Y no en cada partícula), 
+        //todas las partículas que la comparten atraviesan cada transición en el mismo frame:
+        bool is_birth_frame() const
+        {
+            return _life_ahead == _lifetime;
+        }
+        
+        bool is_death_frame() const
+        {
+            return _life_ahead == 0;
+        }
+        
+        float age() const
+        {
+            return 1.0f - ( (float)_life_ahead / _lifetime );
+        }
+        
         template<typename PARTICLE_DATA>
         void operator()( PARTICLE_DATA& particle_data )
         {   
-            if( _life_ahead == _lifetime ) birth( particle_data );
-            if( _life_ahead >  0 )         life( particle_data , 1.0f - ( (float)_life_ahead / _lifetime ) ); //A la política de vida se le pasa un segundo argumento en el intervalo (0,1) que indica la edad de la partícula
-            if( _life_ahead == 0 )         death( particle_data );
+            if( is_birth_frame() ) birth( particle_data );
+            if( _life_ahead >  0 ) life( particle_data , age() ); //A la política de vida se le pasa un segundo argumento en el intervalo (0,1) que indica la edad de la partícula
+            if( is_death_frame() ) death( particle_data );
         }   
         
+        //Versión para grupos de partículas que comparten la política: Las transiciones se comprueban una vez por grupo, no una vez por partícula.
+        //Las políticas derivadas pueden ocultar ésta versión para tratar el nacimiento y la muerte como una operación sobre el grupo entero (Ver fireworks.hpp)
+        template<typename ITERATOR>
+        void operator()( ITERATOR first , ITERATOR last )
+        {
+            if( is_birth_frame() ) 
+                for( auto it = first ; it != last ; ++it )
+                    birth( *it );
+            
+            live( first , last );
+            
+            if( is_death_frame() ) 
+                for( auto it = first ; it != last ; ++it )
+                    death( *it );
+        }
+        
         void step( cpp::evolution_policy_step step_type ) 
         {
-            if( is_alive() && step_type == cpp::evolution_policy_step::global ) _life_ahead--;
+            if( step_type != cpp::evolution_policy_step::global ) return;
+            
+            if( _respawn_pending )
+            {
+                _life_ahead      = _lifetime;
+                _respawn_pending = false;
+            }
+            else if( is_alive() ) 
+                _life_ahead--;
         }
     };
     
@@ -136,19 +216,34 @@ namespace cpp
             segments{ pairs }
         {}
 
-        void operator()( PARTICLE_DATA& particle_data , float age ) const
+        const action_type& segment( float age ) const
         {
             auto segment_it = segments.lower_bound( age );
 
             static_assert( std::is_same<typename decltype(segment_it)::value_type::second_type,action_type>::value , "Ooops" );
 
             if( segment_it != std::end( segments ) )
-                (segment_it->second)( particle_data , age );
+                return segment_it->second;
             else
                 throw std::invalid_argument{ "Incomplete lifetime segments specification: No segment matches this age" };
         }
+        
+        void operator()( PARTICLE_DATA& particle_data , float age ) const
+        {
+            segment( age )( particle_data , age );
+        }
     };
     
+    //Un grupo de partículas con la misma edad está en el mismo segmento: Buscamos el segmento una sola vez.
+    template<typename PARTICLE_DATA , typename ITERATOR>
+    void apply_life_action( cpp::segmented_life_policy<PARTICLE_DATA>& life , ITERATOR first , ITERATOR last , float age )
+    {
+        const auto& action = life.segment( age );
+        
+        for( auto it = first ; it != last ; ++it )
+            action( *it , age );
+    }
+    
     
     //No me gustan tantas llaves, vamos a hacer un builder. (Bueno vale, al final será lo mismo pero con () en lugar de {},
     //era por poner un ejemplo de éste útil patrón más que nada).
@@ -13,6 +13,8 @@
 
 #include "fireworks.hpp"
 #include "bounded.hpp"
+#include "../snippets/frame_arena.hpp"
+#include "frame_export.hpp"
 #include "SFML-2.1/include/SFML/Graphics/Color.hpp"
 
 #include <SFML/Graphics.hpp>
@@ -25,11 +27,15 @@
 #include <sstream>
 #include <iomanip>
 #include <chrono>
+#include <memory>
 
 sf::RenderWindow window;
 
-cpp::fireworks::fireworks_engine engine{ 15000u , dl32::vector_2df{400.0f , 300.0f } , 0.006f };
+cpp::fireworks::fireworks_show engine{ 100000u , cpp::aabb_2d<float>::from_coords_and_size( 100.0f , 350.0f , 600.0f , 250.0f ) };
 cpp::bounded::bounded_engine bounded_engine;
+
+//Si se pasa un nombre de segmento ("/particles", por ejemplo) cada frame se exporta también ahí (Ver cpp::frame_export):
+std::unique_ptr<cpp::shared_frame_writer> frame_writer;
                                            
                                            
 void events_loop()
@@ -60,7 +66,19 @@ void game_loop()
         bounded_engine.step();
         bounded_engine.draw( window );
         
+        if( frame_writer )
+        {
+            cpp::frame_export frame{ *frame_writer , cpp::aabb_2d<float>::from_coords_and_size( 0.0f , 0.0f , 800.0f , 600.0f ) };
+            
+            engine.draw( frame );
+            bounded_engine.draw( frame );
+            frame.publish();
+        }
+        
         window.display();
+        
+        //Fin del frame: La memoria temporal de los pasos vuelve a estar libre
+        cpp::frame_arena::next_frame();
     }
 }
 
@@ -72,31 +90,33 @@ void init_pipeline()
     
     cpp::evolution_policies_pipeline<cpp::default_particle_data_holder> pipeline;
     
-    pipeline.add_stage( cpp::make_bounds_policy( cpp::inverse_bounds<cpp::circle_bounds>{ dl32::vector_2df{ 400.0f , 300.0f } , 300.0f } ) );
-    pipeline.add_stage( cpp::make_bounds_policy( cpp::rectangle_bounds{ cpp::aabb_2d<float>::from_coords_and_size( 0.0f , 0.0f , 800.0f , 600.0f ) } ) );
+    pipeline.add_stage( cpp::make_swept_bounds_policy( cpp::inverse_bounds<cpp::circle_bounds>{ dl32::vector_2df{ 400.0f , 300.0f } , 300.0f } ) );
+    pipeline.add_stage( cpp::make_swept_bounds_policy( cpp::rectangle_bounds{ cpp::aabb_2d<float>::from_coords_and_size( 0.0f , 0.0f , 800.0f , 600.0f ) } ) );
     pipeline.add_stage( []( cpp::default_particle_data_holder& data )
                         {
                            data.speed() *= 1.0001f;
                         }
                       );
-    pipeline.add_stage( []( cpp::default_particle_data_holder& data )
-                        {
-                           data.color() = sf::Color{ (int)data.position().x % 256 , 
-                                                     (int)data.position().y % 256 , 
-                                                     (int)data.position().y % 256 };
-                        }
-                      );
     
+    //El color ya no es una etapa del pipeline: Se calcula al dibujar (Ver cpp::bounded::position_color)
+    
+    //Que el pipeline elija por sí mismo si le conviene ejecutarse por partículas o por etapas:
+    pipeline.execution_order( cpp::pipeline_execution_order::automatic );
     
     bounded_engine.initialize( 100000u , dl32::vector_2df{400.0f , 300.0f } , 0.06f , pipeline );
+    bounded_engine.reorder_period( 256u );
 }
 
-int main()
+int main( int argc , char* argv[] )
 {
+    if( argc > 1 )
+        frame_writer.reset( new cpp::shared_frame_writer{ argv[1] , 3u , 200000u } );
+    
     window.create( sf::VideoMode( 800 , 600 ) , "Particles" );
     
     std::cout << sizeof( cpp::fireworks::particle ) << std::endl;
     std::cout << sizeof( typename decltype( bounded_engine )::particle ) << std::endl;
+    std::cout << sizeof( cpp::bounded::compact_bounded_engine::particle ) << std::endl;
     
     init_pipeline();
     
@@ -18,6 +18,11 @@
 
 #include <SFML/Graphics.hpp>
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
 namespace cpp
 {
     /* Ésta clase encapsula los datos de una partícula (Que pueden ser muy variados y representados de maneras muy diferentes) en una interfaz concreta.
@@ -73,6 +78,163 @@ namespace cpp
             return _speed;
         }
     };
+    
+    //Los datos "normales" se usan tal cual: No necesitan ningún formato para interpretarse.
+    struct no_particle_data_format {};
+    
+    template<typename DATA>
+    const DATA& unpack( const DATA& data , const cpp::no_particle_data_format& )
+    {
+        return data;
+    }
+    
+    template<typename DATA>
+    DATA& unpack( DATA& data , const cpp::no_particle_data_format& )
+    {
+        return data;
+    }
+    
+    template<typename DATA>
+    void pack( DATA& data , const DATA& unpacked , const cpp::no_particle_data_format& )
+    {
+        data = unpacked;
+    }
+    
+    
+    namespace impl
+    {
+        //Float de 24 bits: Los 24 bits altos de un float (Signo, exponente, y 15 bits de mantisa), redondeando al más
+        //cercano. Tiene el mismo rango que un float, y un error relativo menor que 2^-16:
+        inline std::uint32_t float_to_float24( float value )
+        {
+            std::uint32_t bits;
+            std::memcpy( &bits , &value , sizeof( bits ) );
+            
+            //Infinitos y NaN no se redondean (El acarreo cambiaría el exponente). En el resto, si se desborda la mantisa 
+            //el acarreo pasa al exponente, que es lo correcto:
+            if( ( bits & 0x7F800000u ) != 0x7F800000u )
+                bits += 0x80u;
+            
+            return bits >> 8;
+        }
+        
+        inline float float24_to_float( std::uint32_t float24 )
+        {
+            std::uint32_t bits = float24 << 8;
+            
+            float value;
+            std::memcpy( &value , &bits , sizeof( value ) );
+            
+            return value;
+        }
+    }
+    
+    /* Con decenas de millones de partículas, el cuello de botella es el ancho de banda de memoria, no la CPU. 
+     * compact_particle_data_holder guarda una partícula en 14 bytes (En vez de los 20 de default_particle_data_holder):
+     *
+     *  - Posición en punto fijo, relativa al origen del sistema de partículas: Un int16 con la resolución que diga el formato, 
+     *    más un byte por eje con la fracción de paso que sobra (1/256 de position_step). Sin esa fracción, cada pack() 
+     *    redondearía la posición al paso más cercano, y las componentes de la velocidad menores que medio paso no moverían
+     *    nunca la partícula.
+     *  - Velocidad en floats de 24 bits (Ver impl::float_to_float24()). La media precisión (half float) no basta: Las etapas
+     *    que cambian la velocidad un poco en cada paso (Como multiplicarla por 1.0001) no la cambiarían nunca.
+     *  - Color RGB565 (Sin alfa: Las partículas son opacas).
+     *
+     * Las políticas de evolución y dibujo no trabajan con los datos comprimidos: El grupo (Ver cpp::particle_group) los 
+     * descomprime en un default_particle_data_holder por bloques, ejecuta las políticas, y los vuelve a comprimir. Es decir,
+     * la conversión se hace en la frontera del kernel, y el resto del código sigue viendo la interfaz de siempre.
+     *
+     * Ojo con la precisión: Una partícula a más de 32768*position_step del origen se queda en el borde, cada paso redondea la
+     * posición a position_step/256, y los cambios relativos de la velocidad por debajo de 2^-16 se pierden.
+     */
+    struct compact_particle_format
+    {
+        dl32::vector_2df origin;
+        float position_step;
+        
+        compact_particle_format( const dl32::vector_2df& origin_ = dl32::vector_2df{ 0.0f , 0.0f } , float position_step_ = 1.0f / 16.0f ) :
+            origin{ origin_ } ,
+            position_step{ position_step_ }
+        {}
+    };
+    
+    class compact_particle_data_holder
+    {
+        std::int16_t  _x , _y;
+        std::uint16_t _speed_x , _speed_y;         //16 bits altos de cada float24...
+        std::uint16_t _color;
+        std::uint8_t  _fraction_x , _fraction_y;   //En 1/256 de paso
+        std::uint8_t  _speed_low_x , _speed_low_y; //... y sus 8 bits bajos
+        
+        static const int fraction_steps = 256;
+        
+        //La posición en 1/256 de paso (24 bits con signo) se reparte entre el int16 y la fracción:
+        static void quantize( float value , float origin , float step , std::int16_t& whole , std::uint8_t& fraction )
+        {
+            float q = std::round( ( value - origin ) / step * fraction_steps );
+            
+            std::int32_t fixed = static_cast<std::int32_t>( std::max( -8388608.0f , std::min( 8388607.0f , q ) ) );
+            
+            fraction = static_cast<std::uint8_t>( fixed & 0xFF );
+            whole    = static_cast<std::int16_t>( ( fixed - fraction ) / fraction_steps );
+        }
+        
+        static float dequantize( std::int16_t whole , std::uint8_t fraction , float origin , float step )
+        {
+            return origin + ( whole * fraction_steps + fraction ) * ( step / fraction_steps );
+        }
+        
+    public:
+        using unpacked_type = cpp::default_particle_data_holder;
+        using format_type   = cpp::compact_particle_format;
+        
+        compact_particle_data_holder() :
+            _x{ 0 } , _y{ 0 } ,
+            _speed_x{ 0 } , _speed_y{ 0 } ,
+            _color{ 0xFFFFu } ,
+            _fraction_x{ 0 } , _fraction_y{ 0 } ,
+            _speed_low_x{ 0 } , _speed_low_y{ 0 }
+        {}
+        
+        unpacked_type unpack( const format_type& format ) const
+        {
+            std::uint16_t r = ( _color >> 11 ) & 0x1Fu , g = ( _color >> 5 ) & 0x3Fu , b = _color & 0x1Fu;
+            
+            return unpacked_type{ dl32::vector_2df{ dequantize( _x , _fraction_x , format.origin.x , format.position_step ) , 
+                                                    dequantize( _y , _fraction_y , format.origin.y , format.position_step ) } ,
+                                  dl32::vector_2df{ impl::float24_to_float( ( static_cast<std::uint32_t>( _speed_x ) << 8 ) | _speed_low_x ) , 
+                                                    impl::float24_to_float( ( static_cast<std::uint32_t>( _speed_y ) << 8 ) | _speed_low_y ) } ,
+                                  sf::Color{ static_cast<sf::Uint8>( ( r << 3 ) | ( r >> 2 ) ) ,
+                                             static_cast<sf::Uint8>( ( g << 2 ) | ( g >> 4 ) ) ,
+                                             static_cast<sf::Uint8>( ( b << 3 ) | ( b >> 2 ) ) } };
+        }
+        
+        void pack( const unpacked_type& data , const format_type& format )
+        {
+            quantize( data.position().x , format.origin.x , format.position_step , _x , _fraction_x );
+            quantize( data.position().y , format.origin.y , format.position_step , _y , _fraction_y );
+            
+            std::uint32_t speed_x = impl::float_to_float24( data.speed().x ) , speed_y = impl::float_to_float24( data.speed().y );
+            
+            _speed_x     = static_cast<std::uint16_t>( speed_x >> 8 );
+            _speed_y     = static_cast<std::uint16_t>( speed_y >> 8 );
+            _speed_low_x = static_cast<std::uint8_t>( speed_x & 0xFFu );
+            _speed_low_y = static_cast<std::uint8_t>( speed_y & 0xFFu );
+            
+            sf::Color color = data.color();
+            _color = static_cast<std::uint16_t>( ( ( color.r >> 3 ) << 11 ) | ( ( color.g >> 2 ) << 5 ) | ( color.b >> 3 ) );
+        }
+    };
+    
+    inline cpp::default_particle_data_holder unpack( const cpp::compact_particle_data_holder& data , const cpp::compact_particle_format& format )
+    {
+        return data.unpack( format );
+    }
+    
+    inline void pack( cpp::compact_particle_data_holder& data , const cpp::default_particle_data_holder& unpacked , const cpp::compact_particle_format& format )
+    {
+        data.pack( unpacked , format );
+    }
 }
 
 #endif	/* DATA_POLICIES_HPP */
@@ -16,6 +16,14 @@
 
 #include <SFML/Graphics.hpp>
 
+#include "../snippets/aabb_2d.h"
+#include "../snippets/frame_arena.hpp"
+#include "frame_export.hpp"
+
+#include <vector>
+#include <type_traits>
+#include <utility>
+
 namespace cpp
 {
     struct pixel_particle_drawing_policy
@@ -23,27 +31,107 @@ namespace cpp
         pixel_particle_drawing_policy() = default;
         pixel_particle_drawing_policy( const pixel_particle_drawing_policy& ) = default;
         
-        //Política de dibujo de una partícula:
-        template<typename DATA>
-        void operator()( std::vector<sf::Vertex>& pixels , DATA& particle_data ) const
+        //Dónde dibuja cada partícula (Ver cpp::particle_group, que lo usa para guardar lo que dibujan las partículas dormidas):
+        using canvas_type = std::vector<sf::Vertex>;
+        
+        //Política de dibujo de una partícula (En cualquier vector de vértices, como los cpp::frame_vector de draw_buffered()):
+        template<typename ALLOCATOR , typename DATA>
+        void operator()( std::vector<sf::Vertex,ALLOCATOR>& pixels , DATA& particle_data ) const
         {
             pixels.emplace_back( sf::Vector2f{ particle_data.position().x , particle_data.position().y } ,
                                  particle_data.color() 
                                );
         }
         
-        //Política de dibujo del conjunto de partículas:
+        //Política de dibujo del conjunto de partículas. Sólo se dibuja lo que cae dentro de la vista actual:
         template<typename PARTICLES>
         void operator()( const PARTICLES& particles , sf::RenderTarget& target ) const
         {
-            std::vector<sf::Vertex> vertices;
+            using group_canvas = typename std::decay<decltype( *std::begin( particles ) )>::type::canvas_t;
+            
+            const sf::View& view = target.getView();
+            auto viewport = cpp::aabb_2d<float>::from_coords_and_size( view.getCenter().x - view.getSize().x / 2.0f , 
+                                                                       view.getCenter().y - view.getSize().y / 2.0f ,
+                                                                       view.getSize().x , view.getSize().y );
+            
+            draw( particles , target , viewport , std::is_same<group_canvas,canvas_type>{} );
+        }
+        
+        //Exportación a otro proceso (Ver cpp::frame_export): Igual que al dibujar, con el área exportada como vista
+        template<typename PARTICLES>
+        void operator()( const PARTICLES& particles , cpp::frame_export& frame ) const
+        {
+            using group_canvas = typename std::decay<decltype( *std::begin( particles ) )>::type::canvas_t;
             
+            draw( particles , frame , frame.area() , std::is_same<group_canvas,canvas_type>{} );
+        }
+        
+    private:
+        //Los grupos guardan sus vértices: Se dibujan directamente desde su buffer, que sólo se regenera donde ha cambiado
+        template<typename PARTICLES , typename TARGET>
+        void draw( const PARTICLES& particles , TARGET& target , const cpp::aabb_2d<float>& viewport , std::true_type ) const
+        {
             for( auto& particle : particles )
-                particle.draw( vertices );
+                particle.draw_buffered( viewport , [&]( canvas_type::const_iterator first , canvas_type::const_iterator last )
+                {
+                    target.draw( &*first , static_cast<std::size_t>( last - first ) , sf::Points );
+                });
+        }
+        
+        template<typename PARTICLES , typename TARGET>
+        void draw( const PARTICLES& particles , TARGET& target , const cpp::aabb_2d<float>& viewport , std::false_type ) const
+        {
+            cpp::frame_vector<sf::Vertex> vertices;
+            
+            for( auto& particle : particles )
+                particle.draw( vertices , viewport );
             
             target.draw( vertices.data() , vertices.size() , sf::Points );
         }
     };
+    
+    /* El color de una partícula sólo se usa al dibujarla. En vez de calcularlo en cada step() y guardarlo en los datos
+     * de la partícula (Aunque ese frame no se dibuje, o la partícula no se vea), el color puede ser un atributo derivado:
+     * Una función de los datos de la partícula que se evalúa durante el dibujado, y sólo para las partículas que se dibujan.
+     *
+     * COLOR es cualquier cosa que se pueda llamar como sf::Color( const DATA& ). Si el color depende también de algo que
+     * no está en los datos de la partícula (Por ejemplo la fase de la política, ver cpp::fireworks::phase_color), COLOR lo
+     * dice con un generation() que devuelve un entero que cambia cada vez que ese algo cambia: Los grupos que guardan 
+     * sus vértices (Ver cpp::particle_group::draw_buffered()) los regeneran entonces todos.
+     */
+    template<typename COLOR>
+    struct derived_color_drawing_policy : public cpp::pixel_particle_drawing_policy
+    {
+        COLOR color;
+        
+        derived_color_drawing_policy( const COLOR& color_function = COLOR{} ) :
+            color{ color_function }
+        {}
+        
+        //El dibujado del conjunto de partículas es el mismo:
+        using cpp::pixel_particle_drawing_policy::operator();
+        
+        template<typename ALLOCATOR , typename DATA>
+        void operator()( std::vector<sf::Vertex,ALLOCATOR>& pixels , DATA& particle_data ) const
+        {
+            pixels.emplace_back( sf::Vector2f{ particle_data.position().x , particle_data.position().y } ,
+                                 color( particle_data ) 
+                               );
+        }
+        
+        template<typename C = COLOR>
+        auto generation() const -> decltype( std::declval<const C&>().generation() )
+        {
+            return color.generation();
+        }
+
+    };
+    
+    template<typename COLOR>
+    cpp::derived_color_drawing_policy<COLOR> make_derived_color_drawing_policy( const COLOR& color )
+    {
+        return cpp::derived_color_drawing_policy<COLOR>{ color };
+    }
 }
 
 #endif	/* PARTICLE_DRAWING_POLICIES_HPP */
@@ -16,10 +16,12 @@
 
 #include <functional>
 #include <memory>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
 #include "../snippets/Turbo/core.hpp"
+#include "../snippets/radix_sort.hpp"
 
 namespace cpp
 {
@@ -69,14 +71,86 @@ namespace cpp
         TURBO_DEFINE_FUNCTION( has_call , (typename T , typename PDATA , typename U = void) , (T,PDATA,U) , (tml::false_type) );
         
         template<typename T , typename PDATA>
-        struct has_call_t<T,PDATA,dummy_sfinae_thing<decltype( std::declval<T>()( std::declval<PDATA>() ) )>> : public tml::function<tml::true_type> {};
+        struct has_call_t<T,PDATA,dummy_sfinae_thing<decltype( std::declval<T&>()( std::declval<PDATA&>() ) )>> : public tml::function<tml::true_type> {};
+        
+        //A trait which checks if a type can be called with a range of particles (A group call):
+        TURBO_DEFINE_FUNCTION( has_group_call , (typename T , typename ITERATOR , typename U = void) , (T,ITERATOR,U) , (tml::false_type) );
+        
+        template<typename T , typename ITERATOR>
+        struct has_group_call_t<T,ITERATOR,dummy_sfinae_thing<decltype( std::declval<T&>()( std::declval<ITERATOR>() , std::declval<ITERATOR>() ) )>> : public tml::function<tml::true_type> {};
+        
+        //A trait which checks if a type can be called with a range of particles and their state columns (A stated group call):
+        TURBO_DEFINE_FUNCTION( has_stated_group_call , (typename T , typename ITERATOR , typename STATES , typename U = void) , (T,ITERATOR,STATES,U) , (tml::false_type) );
+        
+        template<typename T , typename ITERATOR , typename STATES>
+        struct has_stated_group_call_t<T,ITERATOR,STATES,dummy_sfinae_thing<decltype( std::declval<T&>()( std::declval<ITERATOR>() , std::declval<ITERATOR>() , std::declval<STATES&>() ) )>> : public tml::function<tml::true_type> {};
+        
+        //A trait which checks if a type declares the state it needs per particle:
+        TURBO_DEFINE_FUNCTION( has_particle_state , (typename T , typename U = void) , (T,U) , (tml::false_type) );
+        
+        template<typename T>
+        struct has_particle_state_t<T,dummy_sfinae_thing<typename T::particle_state>> : public tml::function<tml::true_type> {};
+        
+        //A trait which checks if a type provides its own storage for the per-particle state (See evolution_policies_pipeline):
+        TURBO_DEFINE_FUNCTION( has_particle_state_column , (typename T , typename U = void) , (T,U) , (tml::false_type) );
+        
+        template<typename T>
+        struct has_particle_state_column_t<T,dummy_sfinae_thing<typename T::particle_state_column>> : public tml::function<tml::true_type> {};
+        
+        //A trait which checks if a type splits its shared state in per-thread shards (See cpp::has_sharded_state):
+        TURBO_DEFINE_FUNCTION( has_shard_type , (typename T , typename U = void) , (T,U) , (tml::false_type) );
+        
+        template<typename T>
+        struct has_shard_type_t<T,dummy_sfinae_thing<typename T::shard_type>> : public tml::function<tml::true_type> {};
     }   
     
+    //The policy instance behind a (Possibly shared) policy:
+    TURBO_DEFINE_FUNCTION( policy_instance_type , (typename POLICY) , (POLICY) , (POLICY) );
+    
+    template<typename T>
+    struct policy_instance_type_t<cpp::shared_policy<T>> : public tml::function<T> {};
+    
+    template<typename POLICY>
+    POLICY& policy_instance( POLICY& policy )
+    {
+        return policy;
+    }
+    
+    template<typename POLICY>
+    POLICY& policy_instance( cpp::shared_policy<POLICY>& policy )
+    {
+        return *policy;
+    }
+    
+    template<typename POLICY>
+    const POLICY& policy_instance( const POLICY& policy )
+    {
+        return policy;
+    }
+    
+    template<typename POLICY>
+    const POLICY& policy_instance( const cpp::shared_policy<POLICY>& policy )
+    {
+        return *policy;
+    }
+    
     template<typename POLICY>
     using has_state = impl::has_step<POLICY>;
     
+    /* Some policies need state per particle, not per policy instance (For example, bounded_space_evolution_policy has to remember
+     * if each particle was inside or outside the bounds). Storing that state inside the policy would force to have one policy
+     * instance per particle. 
+     * Instead, those policies declare the state type they need through a particle_state member type, and are called as 
+     * policy( data , state ). The state is stored by the particle group in dense columns next to the particle data, so the policy 
+     * itself stays stateless and can be shared by the whole group. The initial state of each particle is given by 
+     * policy.initial_state().
+     */
+    template<typename POLICY>
+    using has_particle_state = impl::has_particle_state<cpp::policy_instance_type<POLICY>>;
+    
     template<typename POLICY , typename PARTICLE_DATA>
-    using is_nonshared_policy = impl::has_call<POLICY,PARTICLE_DATA>;
+    using is_nonshared_policy = tml::logical_or<impl::has_call<POLICY,PARTICLE_DATA>,
+                                                tml::logical_or<impl::has_particle_state<POLICY>,impl::has_particle_state_column<POLICY>>>;
     
     template<typename POLICY , typename PARTICLE_DATA>
     using is_nonshared_stated_policy = tml::logical_and<is_nonshared_policy<POLICY,PARTICLE_DATA>,impl::has_step<POLICY>>;
@@ -95,6 +169,12 @@ namespace cpp
     template<typename T , typename PDATA>
     struct is_shared_nonstated_policy_t<cpp::shared_policy<T>,PDATA> : public tml::function<is_nonshared_nonstated_policy<T,PDATA>> {};
     
+    //Group policies are executed once over the whole range of particles sharing them, instead of once per particle:
+    TURBO_DEFINE_FUNCTION( is_group_policy , (typename T , typename ITERATOR) , (T,ITERATOR) , (impl::has_group_call<T,ITERATOR>) );
+    
+    template<typename T , typename ITERATOR>
+    struct is_group_policy_t<cpp::shared_policy<T>,ITERATOR> : public tml::function<impl::has_group_call<T,ITERATOR>> {};
+    
     template<typename T , typename PARTICLE_DATA>
     using is_policy = tml::logical_or<is_nonshared_policy<T,PARTICLE_DATA>,is_shared_policy<T,PARTICLE_DATA>>;
     template<typename T , typename PARTICLE_DATA>
@@ -102,6 +182,137 @@ namespace cpp
     template<typename T , typename PARTICLE_DATA>
     using is_nonstated_policy = tml::logical_or<is_nonshared_policy<T,PARTICLE_DATA>,is_shared_nonstated_policy<T,PARTICLE_DATA>>;
     
+    /* Policies are classified by the state they write while they process particles:
+     *  - Pure policies: No state at all, they can be called from any thread.
+     *  - Per-particle stated policies (See has_particle_state): The state lives in the group columns, one per particle.
+     *  - Shared stated policies (See is_stated_policy): The policy instance itself changes, so it can't be called from
+     *    several threads at once.
+     *
+     * A shared stated policy can still be processed in parallel if it moves the state it writes while processing particles
+     * to shards: It declares a (Default constructible) shard_type, is called as policy( first , last , index , shard ) (index 
+     * being the position of *first inside the group) writing only to the particles of the range and to that shard, and 
+     * policy.merge( shards ) folds all the shards back into the policy (Resetting them). The group keeps one shard per worker 
+     * of the thread pool, and merges them right before the global step. Sharded calls don't get per-particle state columns.
+     */
+    enum class policy_state_kind
+    {
+        pure ,
+        per_particle ,
+        shared
+    };
+    
+    //Per-particle state is checked first: Those policies can have a step() too (So they are stated policies), but what 
+    //they write while processing particles goes to the columns of the group, not to the policy:
+    template<typename POLICY , typename PARTICLE_DATA>
+    constexpr cpp::policy_state_kind policy_state_kind_of()
+    {
+        return impl::has_particle_state<cpp::policy_instance_type<POLICY>>::value || 
+               impl::has_particle_state_column<cpp::policy_instance_type<POLICY>>::value ? cpp::policy_state_kind::per_particle :
+               cpp::is_stated_policy<POLICY,PARTICLE_DATA>::value                        ? cpp::policy_state_kind::shared :
+                                                                                           cpp::policy_state_kind::pure;
+    }
+    
+    template<typename POLICY , typename PARTICLE_DATA>
+    using policy_state_kind_t = std::integral_constant<cpp::policy_state_kind,cpp::policy_state_kind_of<POLICY,PARTICLE_DATA>()>;
+    
+    template<typename POLICY>
+    using has_sharded_state = impl::has_shard_type<cpp::policy_instance_type<POLICY>>;
+    
+    //Storage of the per-particle state of a policy: A dense column with one state per particle.
+    template<typename STATE>
+    class particle_state_column_t
+    {
+    public:
+        template<typename POLICY>
+        void resize( std::size_t count , const POLICY& policy )
+        {
+            _states.resize( count , policy.initial_state() );
+        }
+        
+        STATE& operator[]( std::size_t index )
+        {
+            return _states[_offset + index];
+        }
+        
+        const STATE& operator[]( std::size_t index ) const
+        {
+            return _states[_offset + index];
+        }
+        
+        std::size_t size() const
+        {
+            return _states.size();
+        }
+        
+        //When the particles are processed in chunks, the policy indices are relative to the first particle of the chunk:
+        void offset( std::size_t first )
+        {
+            _offset = first;
+        }
+        
+        //The particles have been reordered (See particle_group::reorder()), their states have to follow them:
+        void permute( const std::vector<std::size_t>& order )
+        {
+            cpp::apply_permutation( _states , order );
+        }
+        
+    private:
+        std::vector<STATE> _states;
+        std::size_t _offset = 0;
+    };
+    
+    //Stateless policies have no state columns at all:
+    struct no_particle_state
+    {
+        template<typename POLICY>
+        void resize( std::size_t , const POLICY& )
+        {}
+        
+        void offset( std::size_t )
+        {}
+        
+        void permute( const std::vector<std::size_t>& )
+        {}
+    };
+    
+    namespace impl
+    {
+        template<typename POLICY , typename HAS_STATE , typename HAS_STATE_COLUMN>
+        struct particle_state_column_selector : public tml::function<cpp::no_particle_state> {};
+        
+        template<typename POLICY>
+        struct particle_state_column_selector<POLICY,tml::true_type,tml::false_type> : public tml::function<cpp::particle_state_column_t<typename POLICY::particle_state>> {};
+        
+        template<typename POLICY , typename HAS_STATE>
+        struct particle_state_column_selector<POLICY,HAS_STATE,tml::true_type> : public tml::function<typename POLICY::particle_state_column> {};
+    }
+    
+    template<typename POLICY>
+    using particle_state_column = typename impl::particle_state_column_selector<cpp::policy_instance_type<POLICY>,
+                                                                                impl::has_particle_state<cpp::policy_instance_type<POLICY>>,
+                                                                                impl::has_particle_state_column<cpp::policy_instance_type<POLICY>>
+                                                                               >::result;
+    
+    //Policies without shards:
+    struct no_policy_shards
+    {
+        void resize( std::size_t )
+        {}
+    };
+    
+    namespace impl
+    {
+        template<typename POLICY , typename HAS_SHARDS>
+        struct policy_shards_selector : public tml::function<cpp::no_policy_shards> {};
+        
+        template<typename POLICY>
+        struct policy_shards_selector<POLICY,tml::true_type> : public tml::function<std::vector<typename POLICY::shard_type>> {};
+    }
+    
+    //Storage of the shards of a policy (One per thread):
+    template<typename POLICY>
+    using policy_shards = typename impl::policy_shards_selector<cpp::policy_instance_type<POLICY>,cpp::has_sharded_state<POLICY>>::result;
+    
     namespace evolution_policy_categories
     {
         struct shared {};
@@ -166,6 +377,12 @@ namespace cpp
             {
                 (*policy)( data );
             }
+            
+            template<typename ITERATOR>
+            static void execute( POLICY& policy , ITERATOR first , ITERATOR last )
+            {
+                (*policy)( first , last );
+            }
         };
         
         template<typename POLICY>
@@ -176,6 +393,12 @@ namespace cpp
             {
                 policy( data );
             }
+            
+            template<typename ITERATOR>
+            static void execute( POLICY& policy , ITERATOR first , ITERATOR last )
+            {
+                policy( first , last );
+            }
         };
     }
     
@@ -185,11 +408,121 @@ namespace cpp
         impl::caller<POLICY,cpp::is_shared_policy<POLICY,PARTICLE_DATA>>::execute( policy , data );
     }
     
+    //Executes a policy over a range of particles sharing it (See lifetime_policy):
+    template<typename POLICY , typename ITERATOR>
+    void policy_call( POLICY& policy , ITERATOR first , ITERATOR last )
+    {
+        using particle_data = typename std::remove_reference<decltype( *first )>::type;
+        
+        impl::caller<POLICY,cpp::is_shared_policy<POLICY,particle_data>>::execute( policy , first , last );
+    }
+    
     template<typename PARTICLE_DATA , typename POLICY>
     void policy_step( POLICY& policy , cpp::evolution_policy_step step_type )
     {
         impl::stepper<POLICY,cpp::is_shared_policy<POLICY,PARTICLE_DATA> , cpp::is_stated_policy<POLICY,PARTICLE_DATA>>::execute( policy , step_type );
     }
+    
+    namespace impl
+    {
+        template<typename POLICY , typename IS_GROUP_POLICY>
+        struct group_caller;
+        
+        template<typename POLICY>
+        struct group_caller<POLICY,tml::true_type>
+        {
+            template<typename ITERATOR>
+            static void execute( POLICY& policy , ITERATOR first , ITERATOR last )
+            {
+                cpp::policy_call( policy , first , last );
+            }
+        };
+        
+        //Non-group policies are executed particle by particle, exactly as policied_particle does:
+        template<typename POLICY>
+        struct group_caller<POLICY,tml::false_type>
+        {
+            template<typename ITERATOR>
+            static void execute( POLICY& policy , ITERATOR first , ITERATOR last )
+            {
+                using particle_data = typename std::remove_reference<decltype( *first )>::type;
+                
+                for( auto it = first ; it != last ; ++it )
+                {
+                    cpp::policy_call( policy , *it );
+                    cpp::policy_step<particle_data>( policy , cpp::evolution_policy_step::individual );
+                }
+            }
+        };
+    }
+    
+    //Executes a policy over a group of particles sharing it, whatever kind of policy it is:
+    template<typename POLICY , typename ITERATOR>
+    void policy_group_call( POLICY& policy , ITERATOR first , ITERATOR last )
+    {
+        impl::group_caller<POLICY,cpp::is_group_policy<POLICY,ITERATOR>>::execute( policy , first , last );
+    }
+    
+    namespace impl
+    {
+        template<typename POLICY , typename IS_GROUP_POLICY>
+        struct stated_group_caller;
+        
+        template<typename POLICY>
+        struct stated_group_caller<POLICY,tml::true_type>
+        {
+            template<typename ITERATOR , typename STATES>
+            static void execute( POLICY& policy , ITERATOR first , ITERATOR last , STATES& states )
+            {
+                cpp::policy_instance( policy )( first , last , states );
+            }
+        };
+        
+        template<typename POLICY>
+        struct stated_group_caller<POLICY,tml::false_type>
+        {
+            template<typename ITERATOR , typename STATES>
+            static void execute( POLICY& policy , ITERATOR first , ITERATOR last , STATES& states )
+            {
+                using particle_data = typename std::remove_reference<decltype( *first )>::type;
+                
+                auto& instance = cpp::policy_instance( policy );
+                std::size_t i = 0;
+                
+                for( auto it = first ; it != last ; ++it , ++i )
+                {
+                    instance( *it , states[i] );
+                    cpp::policy_step<particle_data>( policy , cpp::evolution_policy_step::individual );
+                }
+            }
+        };
+    }
+    
+    //Same as above, but with the state columns of the policy. The i-th state belongs to the i-th particle of the range:
+    template<typename POLICY , typename ITERATOR , typename STATES>
+    void policy_group_call( POLICY& policy , ITERATOR first , ITERATOR last , STATES& states )
+    {
+        impl::stated_group_caller<POLICY,impl::has_stated_group_call<cpp::policy_instance_type<POLICY>,ITERATOR,STATES>>::execute( policy , first , last , states );
+    }
+    
+    template<typename POLICY , typename ITERATOR>
+    void policy_group_call( POLICY& policy , ITERATOR first , ITERATOR last , cpp::no_particle_state& )
+    {
+        cpp::policy_group_call( policy , first , last );
+    }
+    
+    //Processes a range writing only to the given shard (See has_sharded_state). index is the position of *first in the group:
+    template<typename POLICY , typename ITERATOR , typename SHARD>
+    void policy_sharded_call( POLICY& policy , ITERATOR first , ITERATOR last , std::size_t index , SHARD& shard )
+    {
+        cpp::policy_instance( policy )( first , last , index , shard );
+    }
+    
+    template<typename POLICY , typename SHARDS>
+    void policy_merge( POLICY& policy , SHARDS& shards )
+    {
+        cpp::policy_instance( policy ).merge( shards );
+    }
 }
 
 #endif	/* PARTICLE_EVOLUTION_POLICIES_HPP */
@@ -0,0 +1,822 @@
+/****************************************************************************
+* Snippets, ejemplos, y utilidades del curso de C++ orientado a videojuegos *
+* https://github.com/Manu343726/CppVideojuegos/                             *
+*                                                                           *
+* Copyright © 2014 Manuel Sánchez Pérez                                     *
+*                                                                           *
+* This program is free software. It comes without any warranty, to          *
+* the extent permitted by applicable law. You can redistribute it           *
+* and/or modify it under the terms of the Do What The Fuck You Want         *
+* To Public License, Version 2, as published by Sam Hocevar. See            *
+* http://www.wtfpl.net/  and the COPYING file for more details.             *
+****************************************************************************/
+
+#ifndef PARTICLE_GROUP_HPP
+#define	PARTICLE_GROUP_HPP
+
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include "particle_evolution_policies.hpp"
+#include "particle_data_policies.hpp"
+#include "../snippets/aabb_2d.h"
+#include "../snippets/thread_pool.hpp"
+#include "../snippets/radix_sort.hpp"
+#include "../snippets/chunk_arena.hpp"
+#include "../snippets/slot_map.hpp"
+
+namespace cpp
+{
+    namespace impl
+    {
+        //Datos comprimidos (Ver cpp::compact_particle_data_holder): Declaran el tipo de los datos descomprimidos, y el 
+        //formato necesario para descomprimirlos:
+        TURBO_DEFINE_FUNCTION( is_packed_particle_data , (typename T , typename U = void) , (T,U) , (tml::false_type) );
+        
+        template<typename T>
+        struct is_packed_particle_data_t<T,dummy_sfinae_thing<typename T::unpacked_type>> : public tml::function<tml::true_type> {};
+        
+        TURBO_DEFINE_FUNCTION( unpacked_particle_data , (typename T , typename U = void) , (T,U) , (T) );
+        
+        template<typename T>
+        struct unpacked_particle_data_t<T,dummy_sfinae_thing<typename T::unpacked_type>> : public tml::function<typename T::unpacked_type> {};
+        
+        TURBO_DEFINE_FUNCTION( particle_data_format , (typename T , typename U = void) , (T,U) , (cpp::no_particle_data_format) );
+        
+        template<typename T>
+        struct particle_data_format_t<T,dummy_sfinae_thing<typename T::format_type>> : public tml::function<typename T::format_type> {};
+        
+        //Políticas que guardan índices de partículas (Ver cpp::predictive_bounds_policy): Necesitan enterarse cuando el grupo 
+        //reordena sus partículas
+        TURBO_DEFINE_FUNCTION( has_permute , (typename T , typename U = void) , (T,U) , (tml::false_type) );
+        
+        template<typename T>
+        struct has_permute_t<T,dummy_sfinae_thing<decltype( std::declval<T&>().permute( std::declval<const std::vector<std::size_t>&>() ) )>> : public tml::function<tml::true_type> {};
+        
+        //Políticas que saben decir si en el paso actual no van a tocar las partículas paradas (Ver cpp::lifetime_policy::idle()):
+        TURBO_DEFINE_FUNCTION( has_idle , (typename T , typename U = void) , (T,U) , (tml::false_type) );
+        
+        template<typename T>
+        struct has_idle_t<T,dummy_sfinae_thing<decltype( std::declval<const T&>().idle() )>> : public tml::function<tml::true_type> {};
+        
+        //Dónde dibuja una política de dibujo (Ver cpp::pixel_particle_drawing_policy::canvas_type). Sin eso no se puede
+        //guardar lo que dibujan las partículas dormidas:
+        struct no_canvas {};
+        
+        TURBO_DEFINE_FUNCTION( drawing_canvas , (typename T , typename U = void) , (T,U) , (no_canvas) );
+        
+        template<typename T>
+        struct drawing_canvas_t<T,dummy_sfinae_thing<typename T::canvas_type>> : public tml::function<typename T::canvas_type> {};
+        
+        //Políticas de dibujo cuyo resultado puede cambiar sin que cambien las partículas (Ver cpp::derived_color_drawing_policy::generation()):
+        TURBO_DEFINE_FUNCTION( has_generation , (typename T , typename U = void) , (T,U) , (tml::false_type) );
+        
+        template<typename T>
+        struct has_generation_t<T,dummy_sfinae_thing<decltype( std::declval<const T&>().generation() )>> : public tml::function<tml::true_type> {};
+    }
+    
+    /* Cuando muchas partículas comparten la misma política de evolución (Por ejemplo los equipos del sistema de fuegos artificiales),
+     * no tiene sentido que cada partícula guarde una copia (O un puntero) de la política: Las agrupamos.
+     *
+     * Un grupo guarda la política una sola vez, y los datos de sus partículas de manera contigua. La política se ejecuta
+     * sobre el rango entero de partículas del grupo (Ver cpp::policy_group_call()), así que el bucle principal no tiene
+     * ninguna indirección por partícula.
+     *
+     * Si la política necesita estado por partícula (Ver cpp::has_particle_state), el grupo guarda ese estado en columnas
+     * densas junto a los datos de las partículas: La política sigue siendo única y compartida por todo el grupo.
+     *
+     * Además, el grupo mantiene la caja (AABB) que envuelve cada bloque de partículas. Las cajas se recalculan en cada paso
+     * (Una reducción min/max en paralelo), y al dibujar se descartan enteros los bloques que quedan fuera de la vista.
+     *
+     * Si los datos de las partículas están comprimidos (Ver cpp::compact_particle_data_holder), las políticas se ejecutan bloque
+     * a bloque sobre una copia descomprimida del bloque, que luego se vuelve a comprimir. Las políticas de grupo se llaman 
+     * entonces una vez por bloque.
+     *
+     * Con el tiempo, partículas contiguas en memoria acaban en puntos muy distintos de la pantalla. Si se le indica un periodo
+     * (Ver reorder_period()), el grupo reordena sus partículas cada cierto número de frames según el código de Morton de su
+     * posición, de forma que partículas cercanas en el espacio vuelvan a estar cerca en memoria.
+     *
+     * Las partículas paradas que la política no va a tocar (Ver cpp::lifetime_policy::idle()) se duermen: Se mueven al final
+     * del grupo, donde step() ya no las recorre, y lo que dibujan se guarda (Si la política de dibujo dice dónde dibuja) para 
+     * no volver a generarlo cada frame. En cuanto la política vuelve a estar activa, o se añaden o se tocan partículas desde 
+     * fuera (begin()/end() no constantes), se despiertan todas.
+     *
+     * Para dibujar sin regenerar todos los vértices cada frame (Ver draw_buffered()), el grupo guarda un vértice por partícula,
+     * junto con una copia de los datos (Tal cual se guardan) con los que se generó. Los bloques en los que algún dato ha 
+     * cambiado (Posición, velocidad, color...) se marcan como sucios en el mismo recorrido que recalcula las cajas, comparando
+     * bytes, sin evaluar colores. Si lo que dibuja la política puede cambiar sin que cambien los datos (Ver 
+     * cpp::derived_color_drawing_policy::generation()), cuando cambia se regeneran todos. Al dibujar sólo se regeneran los 
+     * bloques sucios que se ven.
+     *
+     * Si la política reparte su estado compartido por hilos (Ver cpp::has_sharded_state), los bloques de partículas se procesan
+     * en paralelo, cada hilo escribiendo en su trozo, y los trozos se juntan justo antes del paso global.
+     *
+     * Como las partículas cambian de sitio (Al reordenarlas o dormirlas), desde fuera se referencian con handles (Ver 
+     * cpp::handle_table): El grupo los mantiene al día en cada permutación.
+     */
+    template<typename DATA_POLICY , typename EVOLUTION_POLICY , typename DRAWING_POLICY>
+    class particle_group
+    {
+    public:
+        using data_policy_t      = DATA_POLICY;
+        using evolution_policy_t = EVOLUTION_POLICY;
+        using drawing_policy_t   = DRAWING_POLICY;
+
+        //Las partículas se guardan en una arena por bloques (Ver cpp::arena_vector): Añadir partículas nunca mueve las que ya hay
+        using storage_t      = cpp::arena_vector<data_policy_t>;
+        using iterator       = typename storage_t::iterator;
+        using const_iterator = typename storage_t::const_iterator;
+        using handle_t       = cpp::slot_handle;
+
+        using state_column_t = cpp::particle_state_column<EVOLUTION_POLICY>;
+        
+        //Estado compartido de la política repartido por hilos (Ver cpp::has_sharded_state):
+        using shards_t          = cpp::policy_shards<EVOLUTION_POLICY>;
+        using has_sharded_state = cpp::has_sharded_state<EVOLUTION_POLICY>;
+        
+        //Qué estado escribe la política mientras procesa las partículas (Ver cpp::policy_state_kind):
+        using state_kind = cpp::policy_state_kind_t<EVOLUTION_POLICY,impl::unpacked_particle_data<DATA_POLICY>>;
+        
+        //Lo que ven las políticas (Los datos descomprimidos, si lo están) y el formato para descomprimirlos:
+        using unpacked_data_t = impl::unpacked_particle_data<DATA_POLICY>;
+        using data_format_t   = impl::particle_data_format<DATA_POLICY>;
+        using is_packed       = impl::is_packed_particle_data<DATA_POLICY>;
+        
+        //Lo que dibujan las partículas dormidas, y el buffer de vértices de draw_buffered() (Un vértice por partícula):
+        using canvas_t       = impl::drawing_canvas<DRAWING_POLICY>;
+        using has_generation = impl::has_generation<DRAWING_POLICY>;
+        
+        //Los datos con los que se generaron los vértices se copian y se comparan byte a byte:
+        static_assert( std::is_trivially_copyable<DATA_POLICY>::value , "The particle data must be trivially copyable" );
+        
+        //Número de partículas de cada bloque con caja propia (Un bloque de la arena):
+        static constexpr std::size_t chunk_size = storage_t::chunk_size();
+
+        particle_group() = default;
+
+        particle_group( const evolution_policy_t& evolution_policy , const drawing_policy_t& drawing_policy = drawing_policy_t{} ,
+                        const data_format_t& data_format = data_format_t{} ) :
+            _evolution_policy{ evolution_policy } ,
+            _drawing_policy{ drawing_policy } ,
+            _data_format{ data_format }
+        {}
+
+        //Devuelve el handle de la primera partícula añadida (Las demás, ver handle_of()):
+        handle_t add( const unpacked_data_t& data , std::size_t count = 1u )
+        {
+            handle_t first = count > 0 ? _handles.insert() : handle_t{};
+            
+            for( std::size_t i = 1 ; i < count ; ++i )
+                _handles.insert();
+            
+            _particles.resize( _particles.size() + count , pack_value( data , is_packed{} ) );
+            _states.resize( _particles.size() , cpp::policy_instance( _evolution_policy ) );
+            
+            //Las nuevas van después de las dormidas:
+            wake();
+            redraw();
+            
+            return first;
+        }
+
+        void reserve( std::size_t count )
+        {
+            _particles.reserve( count );
+            _handles.reserve( count );
+        }
+        
+        //Handles de las partículas: Siguen valiendo aunque las partículas cambien de sitio
+        handle_t handle_of( std::size_t index ) const
+        {
+            return _handles.handle_of( index );
+        }
+        
+        bool contains( const handle_t& handle ) const
+        {
+            return _handles.contains( handle );
+        }
+        
+        //Posición actual de la partícula (El handle tiene que ser válido):
+        std::size_t index_of( const handle_t& handle ) const
+        {
+            return _handles.index( handle );
+        }
+        
+        const_iterator find( const handle_t& handle ) const
+        {
+            return contains( handle ) ? std::begin( _particles ) + index_of( handle ) : std::end( _particles );
+        }
+
+        void step()
+        {
+            //La política puede haber cambiado desde la última vez (Por ejemplo las etapas de un pipeline):
+            _states.resize( _particles.size() , cpp::policy_instance( _evolution_policy ) );
+            
+            update_sleeping( impl::has_idle<cpp::policy_instance_type<EVOLUTION_POLICY>>{} );
+            
+            step( is_packed{} );
+            
+            merge_shards( has_sharded_state{} );
+
+            cpp::policy_step<unpacked_data_t>( _evolution_policy , cpp::evolution_policy_step::global );
+            
+            if( _reorder_period > 0 && ++_frames_since_reorder >= _reorder_period )
+                reorder();
+            
+            update_bounds();
+        }
+        
+        //Cada cuántos frames se reordenan las partículas (0 significa nunca):
+        void reorder_period( std::size_t frames )
+        {
+            _reorder_period = frames;
+        }
+        
+        std::size_t reorder_period() const
+        {
+            return _reorder_period;
+        }
+        
+        //Partículas despiertas (Las primeras awake() del grupo). El resto están dormidas:
+        std::size_t awake() const
+        {
+            return _awake;
+        }
+        
+        std::size_t sleeping() const
+        {
+            return _particles.size() - _awake;
+        }
+        
+        //Despierta todas las partículas. Las cajas de los bloques ya no las cubren todas (Ni a las que se toquen desde fuera)
+        //hasta el siguiente paso:
+        void wake()
+        {
+            _awake = _particles.size();
+            _sleeping_canvas = canvas_t{};
+            _sleeping_bounds = cpp::aabb_2d<float>::empty();
+            _chunk_bounds.clear();
+        }
+        
+        //Ordena las partículas (Y sus columnas de estado) según el código de Morton de su posición:
+        void reorder()
+        {
+            _frames_since_reorder = 0;
+            
+            if( _particles.empty() )
+                return;
+            
+            //Las dormidas se vuelven a separar en el siguiente paso:
+            wake();
+            redraw();
+            
+            //Los temporales del reorden salen de la memoria del frame (Ver cpp::frame_arena):
+            cpp::frame_vector<dl32::vector_2df> positions( _particles.size() );
+            
+            for( std::size_t i = 0 ; i < _particles.size() ; ++i )
+            {
+                auto&& data = cpp::unpack( _particles[i] , _data_format );
+                positions[i] = data.position();
+            }
+            
+            float left = positions.front().x , right = left , bottom = positions.front().y , top = bottom;
+            
+            for( auto& position : positions )
+            {
+                left   = std::min( left   , position.x );
+                right  = std::max( right  , position.x );
+                bottom = std::min( bottom , position.y );
+                top    = std::max( top    , position.y );
+            }
+            
+            //Cuantizamos la posición dentro de la caja del grupo a 16 bits por eje:
+            float scale_x = right > left   ? 65535.0f / ( right - left )   : 0.0f ,
+                  scale_y = top   > bottom ? 65535.0f / ( top   - bottom ) : 0.0f;
+            
+            cpp::frame_vector<std::uint32_t> keys( _particles.size() );
+            
+            cpp::thread_pool::global().parallel_for( keys.size() , chunk_size , [&]( std::size_t begin , std::size_t end )
+            {
+                for( std::size_t i = begin ; i < end ; ++i )
+                    keys[i] = cpp::morton_key( static_cast<std::uint16_t>( ( positions[i].x - left )   * scale_x ) , 
+                                                static_cast<std::uint16_t>( ( positions[i].y - bottom ) * scale_y ) );
+            });
+            
+            std::vector<std::size_t> order;
+            cpp::parallel_radix_sort( keys , order );
+            
+            cpp::apply_permutation( _particles , order );
+            _handles.permute( order );
+            _states.permute( order );
+            permute_policy( order , impl::has_permute<cpp::policy_instance_type<EVOLUTION_POLICY>>{} );
+        }
+
+        template<typename CANVAS>
+        void draw( CANVAS& canvas ) const
+        {
+            for( auto it = std::begin( _particles ) ; it != std::begin( _particles ) + _awake ; ++it )
+            {
+                auto&& data = cpp::unpack( *it , _data_format );
+                _drawing_policy( canvas , data );
+            }
+            
+            draw_sleeping( canvas , std::is_same<CANVAS,canvas_t>{} );
+        }
+        
+        //Dibuja sólo las partículas que caen dentro de viewport:
+        template<typename CANVAS>
+        void draw( CANVAS& canvas , const cpp::aabb_2d<float>& viewport ) const
+        {
+            for( std::size_t chunk = 0 ; chunk * chunk_size < _awake ; ++chunk )
+            {
+                auto first = std::begin( _particles ) + chunk * chunk_size;
+                auto last  = std::begin( _particles ) + std::min( ( chunk + 1 ) * chunk_size , _awake );
+                
+                //Sin cajas actualizadas (Partículas añadidas, despertadas o tocadas después del último paso) se comprueba cada partícula:
+                bool bounds_ready = _chunk_bounds.size() > chunk;
+                
+                if( bounds_ready && viewport.contains( _chunk_bounds[chunk] ) )
+                {
+                    for( auto it = first ; it != last ; ++it )
+                    {
+                        auto&& data = cpp::unpack( *it , _data_format );
+                        _drawing_policy( canvas , data );
+                    }
+                }
+                else if( !bounds_ready || overlaps( viewport , _chunk_bounds[chunk] ) )
+                {
+                    //Bloque en el borde de la vista:
+                    for( auto it = first ; it != last ; ++it )
+                    {
+                        auto&& data = cpp::unpack( *it , _data_format );
+                        
+                        if( viewport.belongs_to( data.position() ) )
+                            _drawing_policy( canvas , data );
+                    }
+                }
+            }
+            
+            if( _awake == _particles.size() )
+                return;
+            
+            if( viewport.contains( _sleeping_bounds ) )
+                draw_sleeping( canvas , std::is_same<CANVAS,canvas_t>{} );
+            else if( overlaps( viewport , _sleeping_bounds ) )
+            {
+                for( auto it = std::begin( _particles ) + _awake ; it != std::end( _particles ) ; ++it )
+                {
+                    auto&& data = cpp::unpack( *it , _data_format );
+
+                    if( viewport.belongs_to( data.position() ) )
+                        _drawing_policy( canvas , data );
+                }
+            }
+        }
+        
+        //Dibujado incremental: Regenera los vértices de los bloques visibles que han cambiado, y llama a draw( first , last ) 
+        //con cada tramo de vértices visibles del buffer (canvas_t::const_iterator). Los vértices de los bloques que no se ven 
+        //pueden estar desfasados, así que nunca se pasan. La política de dibujo tiene que dibujar exactamente un vértice por
+        //partícula (Se comprueba en las compilaciones de depuración; en las demás, lo que sobre se descarta).
+        template<typename DRAW>
+        void draw_buffered( const cpp::aabb_2d<float>& viewport , DRAW draw ) const
+        {
+            std::size_t chunks = ( _particles.size() + chunk_size - 1 ) / chunk_size;
+            
+            bool recolored = generation_changed( has_generation{} );
+            
+            if( _buffered != _particles.size() || recolored )
+            {
+                _vertices.resize( _particles.size() );
+                _drawn.resize( _particles.size() );
+                _dirty.assign( chunks , true );
+                _buffered = _particles.size();
+            }
+            
+            cpp::frame_vector<std::size_t> visible;
+            
+            for( std::size_t chunk = 0 ; chunk < chunks ; ++chunk )
+                if( is_visible( chunk , viewport ) )
+                    visible.push_back( chunk );
+            
+            //Cada bloque sucio se regenera sobre su propio tramo del buffer, así que se reparten entre los hilos sin más:
+            cpp::thread_pool::global().parallel_for( visible.size() , 8u , [&]( std::size_t begin , std::size_t end )
+            {
+                //Los vértices del bloque se generan en memoria del frame (Ver cpp::frame_arena), así que la política tiene que 
+                //poder dibujar también en un cpp::frame_vector:
+                cpp::frame_vector<typename canvas_t::value_type> vertices;
+                
+                for( std::size_t i = begin ; i < end ; ++i )
+                {
+                    std::size_t chunk = visible[i];
+                    
+                    if( !_dirty[chunk] )
+                        continue;
+                    
+                    auto first = std::begin( _particles ) + chunk * chunk_size;
+                    auto last  = std::begin( _particles ) + std::min( ( chunk + 1 ) * chunk_size , _particles.size() );
+                    
+                    std::size_t count = static_cast<std::size_t>( last - first );
+                    
+                    vertices.clear();
+                    
+                    for( auto it = first ; it != last ; ++it )
+                    {
+                        auto&& data = cpp::unpack( *it , _data_format );
+                        _drawing_policy( vertices , data );
+                    }
+                    
+                    //El buffer tiene un vértice por partícula: Una política que dibuje más (O ninguno) descuadraría los bloques
+                    assert( vertices.size() == count && "draw_buffered() needs exactly one vertex per particle" );
+                    
+                    std::copy_n( std::begin( vertices ) , std::min( vertices.size() , count ) , std::begin( _vertices ) + chunk * chunk_size );
+                    std::memcpy( &_drawn[chunk * chunk_size] , &*first , count * sizeof( data_policy_t ) );
+                    _dirty[chunk] = false;
+                }
+            });
+            
+            //Los bloques visibles consecutivos se dibujan de una vez:
+            for( std::size_t i = 0 ; i < visible.size() ; )
+            {
+                std::size_t j = i + 1;
+                
+                while( j < visible.size() && visible[j] == visible[j - 1] + 1 )
+                    ++j;
+                
+                draw( std::begin( _vertices ) + visible[i] * chunk_size , 
+                      std::begin( _vertices ) + std::min( ( visible[j - 1] + 1 ) * chunk_size , _particles.size() ) );
+                
+                i = j;
+            }
+        }
+        
+        //En el siguiente draw_buffered() se regeneran todos los vértices:
+        void redraw()
+        {
+            _buffered = 0;
+        }
+        
+        //Cajas de los bloques de partículas despiertas, según el último paso:
+        const std::vector<cpp::aabb_2d<float>>& chunk_bounds() const
+        {
+            return _chunk_bounds;
+        }
+
+        std::size_t size() const
+        {
+            return _particles.size();
+        }
+
+        //Quien accede a las partículas puede cambiarlas, así que se despiertan todas:
+        iterator begin()
+        {
+            wake();
+            redraw();
+            return std::begin( _particles );
+        }
+
+        iterator end()
+        {
+            wake();
+            redraw();
+            return std::end( _particles );
+        }
+
+        const_iterator begin() const
+        {
+            return std::begin( _particles );
+        }
+
+        const_iterator end() const
+        {
+            return std::end( _particles );
+        }
+
+        const data_format_t& data_format() const
+        {
+            return _data_format;
+        }
+
+        evolution_policy_t& evolution_policy()
+        {
+            return _evolution_policy;
+        }
+
+        const evolution_policy_t& evolution_policy() const
+        {
+            return _evolution_policy;
+        }
+
+    private:
+        void permute_policy( const std::vector<std::size_t>& order , tml::true_type )
+        {
+            cpp::policy_instance( _evolution_policy ).permute( order );
+        }
+        
+        void permute_policy( const std::vector<std::size_t>& , tml::false_type )
+        {}
+        
+        void update_sleeping( tml::true_type )
+        {
+            if( cpp::policy_instance( _evolution_policy ).idle() )
+                sleep();
+            else
+                wake();
+        }
+        
+        //La política no dice si va a tocar las partículas paradas: Nunca se duermen
+        void update_sleeping( tml::false_type )
+        {}
+        
+        bool is_stopped( std::size_t index ) const
+        {
+            auto&& data = cpp::unpack( _particles[index] , _data_format );
+            
+            return data.speed().x == 0.0f && data.speed().y == 0.0f;
+        }
+        
+        //Mueve las partículas despiertas que están paradas al final del grupo (Junto a las que ya dormían):
+        void sleep()
+        {
+            //Se llama en cada paso mientras la política está inactiva, y casi nunca hay nadie nuevo que dormir: Sólo se
+            //construye la permutación si alguna partícula se ha parado
+            std::size_t first_stopped = 0;
+            
+            while( first_stopped < _awake && !is_stopped( first_stopped ) )
+                first_stopped++;
+            
+            if( first_stopped == _awake )
+                return;
+            
+            //La permutación se pasa a los permute() (Que toman un std::vector), así que sólo las dormidas salen del frame:
+            std::vector<std::size_t> order;
+            cpp::frame_vector<std::size_t> asleep;
+            order.reserve( _particles.size() );
+            
+            for( std::size_t i = 0 ; i < _awake ; ++i )
+            {
+                if( i >= first_stopped && is_stopped( i ) )
+                    asleep.push_back( i );
+                else
+                    order.push_back( i );
+            }
+            
+            order.insert( std::end( order ) , std::begin( asleep ) , std::end( asleep ) );
+            
+            for( std::size_t i = _awake ; i < _particles.size() ; ++i )
+                order.push_back( i );
+            
+            cpp::apply_permutation( _particles , order );
+            _handles.permute( order );
+            _states.permute( order );
+            permute_policy( order , impl::has_permute<cpp::policy_instance_type<EVOLUTION_POLICY>>{} );
+            redraw();
+            
+            std::size_t first_asleep = _awake - asleep.size();
+            bool no_sleeping = _awake == _particles.size();
+            
+            for( std::size_t i = first_asleep ; i < _awake ; ++i )
+            {
+                auto&& data = cpp::unpack( _particles[i] , _data_format );
+                
+                //Ya no se mueven, así que lo que dibujan tampoco cambia:
+                cache_sleeping( data , std::is_same<canvas_t,impl::no_canvas>{} );
+                
+                if( no_sleeping && i == first_asleep )
+                    _sleeping_bounds = cpp::aabb_2d<float>::from_coords_and_size( data.position() , dl32::vector_2df{} );
+                else
+                    _sleeping_bounds = cpp::aabb_2d<float>::from_limits( std::max( _sleeping_bounds.top()    , data.position().y ) ,
+                                                                         std::min( _sleeping_bounds.bottom() , data.position().y ) ,
+                                                                         std::min( _sleeping_bounds.left()   , data.position().x ) ,
+                                                                         std::max( _sleeping_bounds.right()  , data.position().x ) );
+            }
+            
+            _awake = first_asleep;
+        }
+        
+        template<typename DATA>
+        void cache_sleeping( const DATA& data , tml::false_type )
+        {
+            _drawing_policy( _sleeping_canvas , data );
+        }
+        
+        template<typename DATA>
+        void cache_sleeping( const DATA& , tml::true_type )
+        {}
+        
+        //Lo que dibujaron las dormidas al dormirse:
+        template<typename CANVAS>
+        void draw_sleeping( CANVAS& canvas , tml::true_type ) const
+        {
+            canvas.insert( std::end( canvas ) , std::begin( _sleeping_canvas ) , std::end( _sleeping_canvas ) );
+        }
+        
+        //No se dibuja donde se guardó: Se dibujan de nuevo
+        template<typename CANVAS>
+        void draw_sleeping( CANVAS& canvas , tml::false_type ) const
+        {
+            for( auto it = std::begin( _particles ) + _awake ; it != std::end( _particles ) ; ++it )
+            {
+                auto&& data = cpp::unpack( *it , _data_format );
+                _drawing_policy( canvas , data );
+            }
+        }
+        
+        void step( tml::false_type )
+        {
+            auto first = std::begin( _particles ) , last = first + _awake;
+            
+            for( auto it = first ; it != last ; ++it )
+                it->position() += it->speed();
+
+            call_policy( first , last , 0 , state_kind{} );
+        }
+        
+        //Sin estado, o con el estado en las columnas del grupo: Una sola llamada sobre todo el rango
+        template<typename ITERATOR , cpp::policy_state_kind KIND>
+        void call_policy( ITERATOR first , ITERATOR last , std::size_t , std::integral_constant<cpp::policy_state_kind,KIND> )
+        {
+            cpp::policy_group_call( _evolution_policy , first , last , _states );
+        }
+        
+        //Estado compartido: Sólo se puede procesar en paralelo si la política lo reparte por hilos
+        template<typename ITERATOR>
+        void call_policy( ITERATOR first , ITERATOR last , std::size_t index , std::integral_constant<cpp::policy_state_kind,cpp::policy_state_kind::shared> )
+        {
+            call_shared( first , last , index , has_sharded_state{} );
+        }
+        
+        template<typename ITERATOR>
+        void call_shared( ITERATOR first , ITERATOR last , std::size_t , tml::false_type )
+        {
+            cpp::policy_group_call( _evolution_policy , first , last , _states );
+        }
+        
+        //Cada hilo procesa sus bloques escribiendo en su propio trozo del estado de la política:
+        template<typename ITERATOR>
+        void call_shared( ITERATOR first , ITERATOR last , std::size_t index , tml::true_type )
+        {
+            static_assert( state_kind::value == cpp::policy_state_kind::shared && has_sharded_state::value ,
+                           "Only shared stated policies with a shard_type can be called from several threads" );
+            
+            auto& pool = cpp::thread_pool::global();
+            
+            _shards.resize( pool.size() );
+            
+            pool.parallel_for( static_cast<std::size_t>( last - first ) , chunk_size , [&]( std::size_t begin , std::size_t end )
+            {
+                cpp::policy_sharded_call( _evolution_policy , first + begin , first + end , index + begin , 
+                                          _shards[cpp::thread_pool::worker_index()] );
+            });
+        }
+        
+        void merge_shards( tml::true_type )
+        {
+            cpp::policy_merge( _evolution_policy , _shards );
+        }
+        
+        void merge_shards( tml::false_type )
+        {}
+        
+        //Datos comprimidos: Las políticas trabajan sobre una copia descomprimida de cada bloque (Que cabe en caché)
+        void step( tml::true_type )
+        {
+            for( std::size_t begin = 0 ; begin < _awake ; begin += chunk_size )
+            {
+                std::size_t end = std::min( begin + chunk_size , _awake );
+                
+                _unpacked.resize( end - begin );
+                
+                for( std::size_t i = begin ; i < end ; ++i )
+                {
+                    auto& particle = _unpacked[i - begin];
+                    
+                    particle = cpp::unpack( _particles[i] , _data_format );
+                    particle.position() += particle.speed();
+                }
+                
+                //Los índices del estado que ve la política son relativos al bloque:
+                _states.offset( begin );
+                
+                call_policy( std::begin( _unpacked ) , std::end( _unpacked ) , begin , state_kind{} );
+                
+                for( std::size_t i = begin ; i < end ; ++i )
+                    cpp::pack( _particles[i] , _unpacked[i - begin] , _data_format );
+            }
+            
+            _states.offset( 0 );
+        }
+        
+        const data_policy_t& pack_value( const unpacked_data_t& data , tml::false_type ) const
+        {
+            return data;
+        }
+        
+        data_policy_t pack_value( const unpacked_data_t& data , tml::true_type ) const
+        {
+            data_policy_t packed;
+            cpp::pack( packed , data , _data_format );
+            
+            return packed;
+        }
+        
+        void update_bounds()
+        {
+            //Las dormidas tienen su propia caja, que no cambia mientras duermen:
+            std::size_t chunks = ( _awake + chunk_size - 1 ) / chunk_size;
+            
+            _chunk_bounds.assign( chunks , cpp::aabb_2d<float>::empty() );
+            
+            //Cada bloque es independiente, así que se reparten entre los hilos sin más:
+            cpp::thread_pool::global().parallel_for( chunks , 8u , [this]( std::size_t begin , std::size_t end )
+            {
+                for( std::size_t chunk = begin ; chunk < end ; ++chunk )
+                {
+                    auto first = std::begin( _particles ) + chunk * chunk_size;
+                    auto last  = std::begin( _particles ) + std::min( ( chunk + 1 ) * chunk_size , _awake );
+                    
+                    auto&& front = cpp::unpack( *first , _data_format );
+                    
+                    float left = front.position().x , right  = left ,
+                          bottom = front.position().y , top = bottom;
+                    
+                    for( auto it = first ; it != last ; ++it )
+                    {
+                        auto&& data = cpp::unpack( *it , _data_format );
+                        
+                        left   = std::min( left   , data.position().x );
+                        right  = std::max( right  , data.position().x );
+                        bottom = std::min( bottom , data.position().y );
+                        top    = std::max( top    , data.position().y );
+                    }
+                    
+                    _chunk_bounds[chunk] = cpp::aabb_2d<float>::from_limits( top , bottom , left , right );
+                    
+                    //¿Ha cambiado algo desde que se generaron sus vértices? (Los bloques que se mueven salen en el primer byte)
+                    if( _buffered == _particles.size() && !_dirty[chunk] )
+                        _dirty[chunk] = std::memcmp( &*first , &_drawn[chunk * chunk_size] , 
+                                                     static_cast<std::size_t>( last - first ) * sizeof( data_policy_t ) ) != 0;
+                }
+            });
+        }
+        
+        //Lo que dibuja la política ha cambiado sin que cambien las partículas:
+        bool generation_changed( tml::true_type ) const
+        {
+            auto generation = _drawing_policy.generation();
+            bool changed    = generation != _generation;
+            
+            _generation = generation;
+            
+            return changed;
+        }
+        
+        bool generation_changed( tml::false_type ) const
+        {
+            return false;
+        }
+        
+        bool is_visible( std::size_t chunk , const cpp::aabb_2d<float>& viewport ) const
+        {
+            std::size_t begin = chunk * chunk_size , end = std::min( begin + chunk_size , _particles.size() );
+            
+            //Sin cajas actualizadas (Partículas añadidas, despertadas o tocadas después del último paso) se considera visible:
+            if( begin < _awake && ( _chunk_bounds.size() <= chunk || overlaps( viewport , _chunk_bounds[chunk] ) ) )
+                return true;
+            
+            return end > _awake && overlaps( viewport , _sleeping_bounds );
+        }
+        
+        //aabb_2d::overlap() no considera que una caja degenerada (Todas las partículas en el mismo punto) sobre el borde solape:
+        static bool overlaps( const cpp::aabb_2d<float>& viewport , const cpp::aabb_2d<float>& bounds )
+        {
+            return bounds.right() >= viewport.left() && bounds.left() <= viewport.right() &&
+                   bounds.top() >= viewport.bottom() && bounds.bottom() <= viewport.top();
+        }
+        
+        evolution_policy_t        _evolution_policy;
+        drawing_policy_t          _drawing_policy;
+        storage_t                 _particles;
+        state_column_t            _states;
+        cpp::handle_table         _handles;
+        shards_t                  _shards;
+        data_format_t             _data_format;
+        std::vector<unpacked_data_t> _unpacked; //Bloque descomprimido (Sólo con datos comprimidos)
+        std::vector<cpp::aabb_2d<float>> _chunk_bounds;
+        std::size_t _reorder_period = 0 , _frames_since_reorder = 0;
+        std::size_t _awake = 0;
+        canvas_t _sleeping_canvas; //Lo que dibujan las partículas dormidas
+        cpp::aabb_2d<float> _sleeping_bounds = cpp::aabb_2d<float>::empty();
+        mutable canvas_t _vertices;                 //Un vértice por partícula (Ver draw_buffered())
+        mutable std::vector<std::uint8_t> _dirty;   //Bloques cuyos vértices hay que regenerar
+        mutable std::size_t _buffered = 0;          //Partículas que cubre el buffer (0 si hay que rehacerlo entero)
+        mutable std::vector<data_policy_t> _drawn;  //Los datos con los que se generó cada vértice
+        mutable std::uint64_t _generation = 0;      //De la política de dibujo, cuando se generaron los vértices
+    };
+}
+
+#endif	/* PARTICLE_GROUP_HPP */
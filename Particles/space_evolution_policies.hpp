@@ -16,14 +16,25 @@
 
 #include "../snippets/aabb_2d.h"
 #include "../snippets/math_2d.h"
+#include "../snippets/thread_pool.hpp"
+#include "../snippets/radix_sort.hpp"
 
 #include <SFML/Graphics.hpp>
 
 #include "../snippets/Turbo/to_string.hpp"
 #include "../snippets/Turbo/core.hpp"
 
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <tuple>
 #include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace cpp
 {
@@ -64,6 +75,17 @@ namespace cpp
     };
     
     
+    //Contacto de un segmento (El recorrido de una partícula en un paso) con el borde de unos límites:
+    struct swept_contact
+    {
+        bool             hit = false;
+        float            time = 0.0f;  //Punto del segmento (0 es el principio, 1 el final)
+        dl32::vector_2df normal;       //Hacia la región de la que viene el segmento
+    };
+
+    //Tolerancia (En unidades de longitud) para considerar que un segmento empieza sobre el borde, por ejemplo después de un rebote:
+    const float swept_contact_tolerance = 1e-3f;
+
     template<typename BOUNDS>
     struct inverse_bounds
     {
@@ -73,12 +95,31 @@ namespace cpp
         inverse_bounds( ARGS&&... args ) :
             bounds{ std::forward<ARGS>( args )... }
         {}
-        
+
+        //Si no, copiar un inverse_bounds no constante usaría el constructor de arriba:
+        inverse_bounds( inverse_bounds& other ) :
+            bounds( other.bounds )
+        {}
+
+        inverse_bounds( const inverse_bounds& ) = default;
+        inverse_bounds( inverse_bounds&& ) = default;
+
         template<typename POINT>
         cpp::bounding_data operator()( const POINT& point ) const
         {
             return bounds( point ).opposite();
         }
+
+        //Salir de los límites invertidos es entrar en los originales, y al revés:
+        cpp::swept_contact exit( const dl32::vector_2df& from , const dl32::vector_2df& to ) const
+        {
+            return bounds.entry( from , to );
+        }
+
+        cpp::swept_contact entry( const dl32::vector_2df& from , const dl32::vector_2df& to ) const
+        {
+            return bounds.exit( from , to );
+        }
     };
     
     template<typename BOUNDS>
@@ -117,6 +158,49 @@ namespace cpp
                 default: throw;
             }
         }
+
+        //Primer punto en el que el segmento from->to sale de la caja (Si empieza dentro). La normal es la del lado por el que
+        //sale, así que en las esquinas no hace falta inventarse una normal diagonal:
+        cpp::swept_contact exit( const dl32::vector_2df& from , const dl32::vector_2df& to ) const
+        {
+            cpp::swept_contact contact;
+            dl32::vector_2df direction = to - from;
+            float enter , leave , length = direction.length();
+            int enter_axis , leave_axis;
+
+            if( length == 0.0f || !aabb.slab_interval( from , direction , enter , leave , enter_axis , leave_axis ) )
+                return contact;
+
+            if( enter <= cpp::swept_contact_tolerance / length && leave >= 0.0f && leave < 1.0f && leave_axis >= 0 )
+            {
+                contact.hit  = true;
+                contact.time = leave;
+                contact.normal[leave_axis] = direction[leave_axis] > 0.0f ? -1.0f : 1.0f;
+            }
+
+            return contact;
+        }
+
+        //Primer punto en el que el segmento from->to entra en la caja (Si empieza fuera):
+        cpp::swept_contact entry( const dl32::vector_2df& from , const dl32::vector_2df& to ) const
+        {
+            cpp::swept_contact contact;
+            dl32::vector_2df direction = to - from;
+            float enter , leave;
+            int enter_axis , leave_axis;
+
+            if( direction.length() == 0.0f || !aabb.slab_interval( from , direction , enter , leave , enter_axis , leave_axis ) )
+                return contact;
+
+            if( enter >= 0.0f && enter <= 1.0f && enter_axis >= 0 )
+            {
+                contact.hit  = true;
+                contact.time = enter;
+                contact.normal[enter_axis] = direction[enter_axis] > 0.0f ? -1.0f : 1.0f;
+            }
+
+            return contact;
+        }
     };
     
     struct circle_bounds : public cpp::bounds_inverser<circle_bounds>
@@ -137,27 +221,243 @@ namespace cpp
             else
                 return { cpp::bounds_state::inside , ( center - point ).normalized() };
         }
+
+        //Primer punto en el que el segmento from->to sale del círculo (Si empieza dentro):
+        cpp::swept_contact exit( const dl32::vector_2df& from , const dl32::vector_2df& to ) const
+        {
+            cpp::swept_contact contact;
+            float near , far , length = ( to - from ).length();
+
+            if( intersection( from , to , near , far ) && near <= cpp::swept_contact_tolerance / length && far >= 0.0f && far < 1.0f )
+            {
+                contact.hit    = true;
+                contact.time   = far;
+                contact.normal = ( center - ( from + ( to - from ) * far ) ).normalized();
+            }
+
+            return contact;
+        }
+
+        //Primer punto en el que el segmento from->to entra en el círculo (Si empieza fuera):
+        cpp::swept_contact entry( const dl32::vector_2df& from , const dl32::vector_2df& to ) const
+        {
+            cpp::swept_contact contact;
+            float near , far;
+
+            if( intersection( from , to , near , far ) && near >= 0.0f && near <= 1.0f )
+            {
+                contact.hit    = true;
+                contact.time   = near;
+                contact.normal = ( ( from + ( to - from ) * near ) - center ).normalized();
+            }
+
+            return contact;
+        }
+
+    private:
+        //Intervalo [near,far] del segmento (En fracciones de su longitud) que está dentro del círculo:
+        bool intersection( const dl32::vector_2df& from , const dl32::vector_2df& to , float& near , float& far ) const
+        {
+            dl32::vector_2df direction = to - from , offset = from - center;
+
+            float a = direction * direction ,
+                  b = 2.0f * ( offset * direction ) ,
+                  c = offset * offset - radious * radious;
+
+            float discriminant = b * b - 4.0f * a * c;
+
+            if( a == 0.0f || discriminant < 0.0f )
+                return false;
+
+            float root = std::sqrt( discriminant );
+
+            near = ( -b - root ) / ( 2.0f * a );
+            far  = ( -b + root ) / ( 2.0f * a );
+
+            return true;
+        }
     };
-    
+
+    /* Límites con cualquier forma: Un conjunto de polígonos
+     *
+     * Calcular la distancia a cada lado de cada polígono por partícula y por frame sería carísimo. En su lugar, la
+     * distancia con signo (Negativa dentro de los polígonos) y su gradiente se precalculan una sola vez en una rejilla
+     * (Un campo de distancias, SDF) que cubre area. Después, cada consulta es una sola interpolación bilineal: Una
+     * geometría complicada cuesta lo mismo por partícula que un círculo.
+     *
+     * Como con los demás límites, "dentro" es dentro de los polígonos y las normales apuntan hacia dentro. Para usar los
+     * polígonos como obstáculos, se invierten (Ver cpp::inverse_bounds).
+     *
+     * area debería envolver los polígonos con algo de margen: Fuera de area se usa el valor del borde más cercano. La
+     * rejilla se comparte entre copias (Las etapas de un pipeline se copian), y no cambia después de construirla.
+     */
+    struct polygon_bounds : public cpp::bounds_inverser<polygon_bounds>
+    {
+        using polygon = std::vector<dl32::vector_2df>;
+
+        polygon_bounds( const std::vector<polygon>& polygons , const cpp::aabb_2d<float>& area , float cell_size ) :
+            _field{ std::make_shared<distance_field>( polygons , area , cell_size ) }
+        {}
+
+        //Distancia con signo interpolada (Negativa dentro de los polígonos):
+        template<typename POINT>
+        float distance( const POINT& point ) const
+        {
+            return _field->sample( point ).distance;
+        }
+
+        template<typename POINT>
+        cpp::bounding_data operator()( const POINT& point ) const
+        {
+            auto sample = _field->sample( point );
+
+            //El gradiente apunta hacia fuera de los polígonos, y el punto más cercano del borde está en su dirección contraria:
+            dl32::vector_2df gradient{ sample.gradient_x , sample.gradient_y };
+            float length = gradient.length();
+
+            if( length > 0.0f )
+                gradient /= length;
+
+            dl32::vector_2df normal{ -gradient.x , -gradient.y };
+
+            return { sample.distance <= 0.0f ? cpp::bounds_state::inside : cpp::bounds_state::outside ,
+                     normal ,
+                     point - gradient * sample.distance };
+        }
+
+    private:
+        struct node
+        {
+            float distance , gradient_x , gradient_y;
+        };
+
+        class distance_field
+        {
+        public:
+            distance_field( const std::vector<polygon>& polygons , const cpp::aabb_2d<float>& area , float cell_size ) :
+                _area( area ) ,
+                _cell_size{ cell_size } ,
+                _columns{ static_cast<std::size_t>( std::ceil( area.width()  / cell_size ) ) + 1 } ,
+                _rows{    static_cast<std::size_t>( std::ceil( area.height() / cell_size ) ) + 1 } ,
+                _nodes( _columns * _rows )
+            {
+                cpp::thread_pool::global().parallel_for( _rows , 4u , [&]( std::size_t begin , std::size_t end )
+                {
+                    for( std::size_t row = begin ; row < end ; ++row )
+                        for( std::size_t column = 0 ; column < _columns ; ++column )
+                            _nodes[row * _columns + column] = bake( polygons , dl32::vector_2df{ _area.left()   + column * _cell_size ,
+                                                                                                 _area.bottom() + row    * _cell_size } );
+                });
+            }
+
+            template<typename POINT>
+            node sample( const POINT& point ) const
+            {
+                float gx = std::min( std::max( ( point.x - _area.left() )   / _cell_size , 0.0f ) , static_cast<float>( _columns - 1 ) ) ,
+                      gy = std::min( std::max( ( point.y - _area.bottom() ) / _cell_size , 0.0f ) , static_cast<float>( _rows - 1 ) );
+
+                std::size_t column = std::min( static_cast<std::size_t>( gx ) , _columns - 2 ) ,
+                            row    = std::min( static_cast<std::size_t>( gy ) , _rows - 2 );
+
+                float tx = gx - column , ty = gy - row;
+
+                const node& a = _nodes[row * _columns + column];
+                const node& b = _nodes[row * _columns + column + 1];
+                const node& c = _nodes[( row + 1 ) * _columns + column];
+                const node& d = _nodes[( row + 1 ) * _columns + column + 1];
+
+                auto lerp2 = [=]( float node::* channel )
+                {
+                    float bottom = a.*channel + ( b.*channel - a.*channel ) * tx ,
+                          top    = c.*channel + ( d.*channel - c.*channel ) * tx;
+
+                    return bottom + ( top - bottom ) * ty;
+                };
+
+                return node{ lerp2( &node::distance ) , lerp2( &node::gradient_x ) , lerp2( &node::gradient_y ) };
+            }
+
+        private:
+            //Distancia exacta de un nodo a los polígonos. Dentro de un polígono si lo está según la regla par-impar:
+            static node bake( const std::vector<polygon>& polygons , const dl32::vector_2df& point )
+            {
+                float best = std::numeric_limits<float>::max();
+                dl32::vector_2df nearest = point;
+                bool inside = false;
+
+                for( auto& vertices : polygons )
+                {
+                    bool inside_polygon = false;
+
+                    for( std::size_t i = 0 , j = vertices.size() - 1 ; i < vertices.size() ; j = i++ )
+                    {
+                        const dl32::vector_2df& a = vertices[j];
+                        const dl32::vector_2df& b = vertices[i];
+
+                        dl32::vector_2df edge = b - a , to_point = point - a;
+                        float edge_length2 = edge * edge;
+                        float t = edge_length2 > 0.0f ? std::min( std::max( ( to_point * edge ) / edge_length2 , 0.0f ) , 1.0f ) : 0.0f;
+
+                        dl32::vector_2df closest = a + edge * t , offset = point - closest;
+                        float distance2 = offset * offset;
+
+                        if( distance2 < best )
+                        {
+                            best = distance2;
+                            nearest = closest;
+                        }
+
+                        if( ( a.y > point.y ) != ( b.y > point.y ) &&
+                            point.x < a.x + ( point.y - a.y ) / ( b.y - a.y ) * edge.x )
+                            inside_polygon = !inside_polygon;
+                    }
+
+                    inside = inside || inside_polygon;
+                }
+
+                float distance = std::sqrt( best );
+                dl32::vector_2df gradient = distance > 0.0f ? ( point - nearest ) / distance : dl32::vector_2df{};
+
+                if( inside )
+                    return node{ -distance , -gradient.x , -gradient.y };
+                else
+                    return node{ distance , gradient.x , gradient.y };
+            }
+
+            cpp::aabb_2d<float> _area;
+            float _cell_size;
+            std::size_t _columns , _rows;
+            std::vector<node> _nodes;
+        };
+
+        std::shared_ptr<const distance_field> _field;
+    };
+
+    //El estado (Dentro/fuera de los límites) es de cada partícula, no de la política: Lo guarda el grupo de partículas
+    //(Ver cpp::has_particle_state), así que una misma política sirve para todas las partículas.
     template<typename BOUNDS>
     class bounded_space_evolution_policy
     {
     public:
+        using particle_state = cpp::bounds_state;
+        
         template<typename... ARGS>
         bounded_space_evolution_policy( ARGS&&... args ) :
-            _bounds{ std::forward<ARGS>( args )... } ,
-            _state{ bounds_state::unknown }
+            _bounds{ std::forward<ARGS>( args )... }
         {}
         
+        particle_state initial_state() const
+        {
+            return cpp::bounds_state::unknown;
+        }
+        
         template<typename PARTICLE_DATA>
-        void operator()( PARTICLE_DATA& data )
+        void operator()( PARTICLE_DATA& data , particle_state& state ) const
         {
-            static const dl32::vector_2df gravity{ 0.00001f , -0.0000998f };
-            
             auto collision_data = _bounds( data.position() );
             
             //Si la partícula está atravesando los límites (Antes estaba dentro y ahora está fuera o viceversa):
-            if( _state == cpp::bounds_state::inside && collision_data.state == cpp::bounds_state::outside )
+            if( state == cpp::bounds_state::inside && collision_data.state == cpp::bounds_state::outside )
             {
                 auto input_direction  = data.speed().normalized();
                 auto output_direction = input_direction.reflexion( collision_data.bounds_normal ); 
@@ -165,7 +465,7 @@ namespace cpp
                 data.speed() = data.speed().length() * output_direction;
             }
             
-            _state = collision_data.state;
+            state = collision_data.state;
         }
         
         void step( cpp::evolution_policy_step step_type )
@@ -174,7 +474,6 @@ namespace cpp
     private:
         
         BOUNDS       _bounds;
-        cpp::bounds_state _state;
     };
     
     template<typename BOUNDS>
@@ -182,6 +481,410 @@ namespace cpp
     {
         return cpp::bounded_space_evolution_policy<BOUNDS>{ std::forward<BOUNDS>( bounds ) };
     }
+
+    struct swept_bounds_state
+    {
+        dl32::vector_2df previous; //Posición al final del paso anterior
+        bool             valid = false;
+    };
+
+    /* Rebotes con detección continua
+     *
+     * bounded_space_evolution_policy detecta los rebotes cuando el estado de la partícula cambia de dentro a fuera entre dos
+     * frames. Una partícula rápida puede atravesar un obstáculo pequeño sin llegar a estar nunca dentro de él, y el rebote se
+     * calcula desde donde haya quedado la partícula, no desde donde tocó el borde.
+     *
+     * Esta política guarda la posición de cada partícula al final del paso anterior, y comprueba el segmento recorrido contra
+     * el borde de los límites (Ver circle_bounds::exit() y rectangle_bounds::exit()). Si el segmento sale de los límites, la
+     * partícula se refleja en el punto de contacto y recorre el resto del segmento en la dirección reflejada (Que a su vez se
+     * comprueba, hasta max_bounces veces: En una esquina hay dos rebotes en el mismo paso).
+     *
+     * Así no se pierden rebotes aunque los pasos sean largos, y se pueden dar menos pasos con velocidades más grandes.
+     */
+    template<typename BOUNDS>
+    class swept_bounds_evolution_policy
+    {
+    public:
+        using particle_state = cpp::swept_bounds_state;
+
+        static const std::size_t max_bounces = 4u;
+
+        template<typename... ARGS>
+        swept_bounds_evolution_policy( ARGS&&... args ) :
+            _bounds{ std::forward<ARGS>( args )... }
+        {}
+
+        particle_state initial_state() const
+        {
+            return particle_state{};
+        }
+
+        template<typename PARTICLE_DATA>
+        void operator()( PARTICLE_DATA& data , particle_state& state ) const
+        {
+            //El primer paso de la partícula no tiene segmento:
+            if( !state.valid )
+            {
+                state.previous = data.position();
+                state.valid = true;
+                return;
+            }
+
+            dl32::vector_2df from = state.previous , to = data.position();
+
+            for( std::size_t bounce = 0 ; bounce < max_bounces ; ++bounce )
+            {
+                cpp::swept_contact contact = _bounds.exit( from , to );
+
+                if( !contact.hit )
+                    break;
+
+                dl32::vector_2df point = from + ( to - from ) * contact.time;
+
+                to = point + ( to - point ).reflexion( contact.normal );
+                data.speed() = data.speed().reflexion( contact.normal );
+                from = point;
+            }
+
+            data.position() = to;
+            state.previous  = to;
+        }
+
+        void step( cpp::evolution_policy_step )
+        {}
+
+    private:
+        BOUNDS _bounds;
+    };
+
+    template<typename BOUNDS>
+    cpp::swept_bounds_evolution_policy<typename std::decay<BOUNDS>::type> make_swept_bounds_policy( BOUNDS&& bounds )
+    {
+        return cpp::swept_bounds_evolution_policy<typename std::decay<BOUNDS>::type>{ std::forward<BOUNDS>( bounds ) };
+    }
+
+    namespace impl
+    {
+        //Primer instante t >= 0 en el que |position + speed * t - center| = radious (Infinito si no hay ninguno):
+        inline float circle_crossing_time( const dl32::vector_2df& center , float radious , const dl32::vector_2df& position , const dl32::vector_2df& speed )
+        {
+            dl32::vector_2df offset = position - center;
+
+            float a = speed * speed ,
+                  b = 2.0f * ( offset * speed ) ,
+                  c = offset * offset - radious * radious;
+
+            float discriminant = b * b - 4.0f * a * c;
+
+            if( a == 0.0f || discriminant < 0.0f )
+                return std::numeric_limits<float>::infinity();
+
+            float root = std::sqrt( discriminant ) ,
+                  near = ( -b - root ) / ( 2.0f * a ) ,
+                  far  = ( -b + root ) / ( 2.0f * a );
+
+            if( near >= 0.0f ) return near;
+            if( far  >= 0.0f ) return far;
+
+            return std::numeric_limits<float>::infinity();
+        }
+
+        //Primer instante t >= 0 en el que el punto entra o sale de la caja (Infinito si no hay ninguno):
+        inline float aabb_crossing_time( const cpp::aabb_2d<float>& box , const dl32::vector_2df& position , const dl32::vector_2df& speed )
+        {
+            float enter , exit;
+            int enter_axis , exit_axis;
+
+            if( !box.slab_interval( position , speed , enter , exit , enter_axis , exit_axis ) )
+                return std::numeric_limits<float>::infinity(); //Nunca está dentro
+
+            if( enter >= 0.0f ) return enter; //Está fuera, y va a entrar
+            if( exit >= 0.0f )  return exit;  //Está dentro, y va a salir
+
+            return std::numeric_limits<float>::infinity();
+        }
+    }
+
+    /* Tiempo (En frames, con velocidad constante) hasta que un punto pase a estar a menos de margin del borde de los límites.
+     * Con margin = 0, hasta que los atraviese en cualquiera de los dos sentidos. Infinito si no va a pasar nunca.
+     */
+    inline float crossing_time( const cpp::circle_bounds& bounds , const dl32::vector_2df& position , const dl32::vector_2df& speed , float margin = 0.0f )
+    {
+        float distance = ( position - bounds.center ).length();
+
+        if( std::fabs( distance - bounds.radious ) <= margin )
+            return 0.0f;
+
+        return std::min( impl::circle_crossing_time( bounds.center , bounds.radious + margin , position , speed ) ,
+                         impl::circle_crossing_time( bounds.center , std::max( bounds.radious - margin , 0.0f ) , position , speed ) );
+    }
+
+    inline float crossing_time( const cpp::rectangle_bounds& bounds , const dl32::vector_2df& position , const dl32::vector_2df& speed , float margin = 0.0f )
+    {
+        const cpp::aabb_2d<float>& box = bounds.aabb;
+
+        bool inside_outer = position.x >= box.left() - margin   && position.x <= box.right() + margin &&
+                            position.y >= box.bottom() - margin && position.y <= box.top() + margin ,
+             inside_inner = position.x > box.left() + margin    && position.x < box.right() - margin &&
+                            position.y > box.bottom() + margin  && position.y < box.top() - margin;
+
+        if( inside_outer && !inside_inner )
+            return 0.0f;
+
+        return std::min( impl::aabb_crossing_time( cpp::aabb_2d<float>::from_limits( box.top() + margin , box.bottom() - margin , box.left() - margin , box.right() + margin ) , position , speed ) ,
+                         impl::aabb_crossing_time( cpp::aabb_2d<float>::from_limits( box.top() - margin , box.bottom() + margin , box.left() + margin , box.right() - margin ) , position , speed ) );
+    }
+
+    template<typename BOUNDS>
+    float crossing_time( const cpp::inverse_bounds<BOUNDS>& bounds , const dl32::vector_2df& position , const dl32::vector_2df& speed , float margin = 0.0f )
+    {
+        return cpp::crossing_time( bounds.bounds , position , speed , margin );
+    }
+
+    namespace impl
+    {
+        template<std::size_t I , std::size_t N>
+        struct tuple_for_each
+        {
+            template<typename TUPLE , typename F>
+            static void apply( TUPLE& tuple , F& f )
+            {
+                f( I , std::get<I>( tuple ) );
+                tuple_for_each<I + 1,N>::apply( tuple , f );
+            }
+        };
+
+        template<std::size_t N>
+        struct tuple_for_each<N,N>
+        {
+            template<typename TUPLE , typename F>
+            static void apply( TUPLE& , F& )
+            {}
+        };
+    }
+
+    /* Rebotes contra los límites sin comprobar cada partícula en cada frame
+     *
+     * Con velocidad constante, el frame en el que una partícula va a atravesar unos límites se puede calcular de antemano
+     * (Ver cpp::crossing_time()). Esta política lo calcula para cada partícula, y la apunta en una rueda de tiempo (Un cubo
+     * por frame, circular): En cada paso sólo se procesan las partículas del cubo del frame actual. El coste deja de ser por
+     * partícula y por frame, y pasa a ser por rebote.
+     *
+     * El comportamiento es el mismo que el de cpp::bounded_space_evolution_policy con los mismos límites (En el mismo orden):
+     * Cuando una partícula sale de unos límites en los que estaba, su velocidad se refleja con la normal de los límites.
+     *
+     * Las predicciones sólo valen si nadie más cambia la dirección de las partículas. Si otra cosa hace crecer su velocidad,
+     * max_speed_growth() es el factor máximo por frame, y las predicciones se hacen con él (Una partícula puede procesarse
+     * antes de tiempo, pero nunca tarde).
+     *
+     * Es una política de grupo que guarda los índices de las partículas del grupo, así que necesita el grupo entero (No vale
+     * como etapa de un pipeline, ni con datos comprimidos). Si el grupo reordena sus partículas, se lo notifica con permute().
+     * Si cambia el número de partículas, todas se vuelven a programar.
+     */
+    template<typename... BOUNDS>
+    class predictive_bounds_policy
+    {
+    public:
+        static const std::size_t wheel_size = 256u; //Frames
+
+        predictive_bounds_policy( BOUNDS... bounds ) :
+            _bounds{ std::move( bounds )... } ,
+            _wheel( wheel_size )
+        {}
+
+        float max_speed_growth() const
+        {
+            return _max_speed_growth;
+        }
+
+        void max_speed_growth( float growth )
+        {
+            _max_speed_growth = std::max( growth , 1.0f );
+        }
+
+        //Partículas procesadas en el último paso:
+        std::size_t events() const
+        {
+            return _events;
+        }
+
+        template<typename ITERATOR>
+        void operator()( ITERATOR first , ITERATOR last )
+        {
+            std::size_t count = static_cast<std::size_t>( std::distance( first , last ) );
+
+            _frame++;
+            _events = 0;
+
+            if( count != _due.size() )
+            {
+                reschedule_all( first , count );
+                return;
+            }
+
+            _current.clear();
+            _current.swap( _wheel[_frame % wheel_size] );
+
+            for( auto index : _current )
+            {
+                //Programada para una vuelta posterior de la rueda:
+                if( _due[index] != _frame )
+                {
+                    _wheel[_due[index] % wheel_size].push_back( index );
+                    continue;
+                }
+
+                process( first[index] , index );
+                schedule( first[index] , index );
+            }
+        }
+
+        void permute( const std::vector<std::size_t>& order )
+        {
+            //order[i] es el índice anterior de la partícula que ahora está en i:
+            cpp::frame_vector<std::uint32_t> new_index( order.size() );
+
+            for( std::size_t i = 0 ; i < order.size() ; ++i )
+                new_index[order[i]] = static_cast<std::uint32_t>( i );
+
+            for( auto& bucket : _wheel )
+                for( auto& index : bucket )
+                    index = new_index[index];
+
+            cpp::apply_permutation( _due , order );
+            cpp::apply_permutation( _states , order );
+        }
+
+    private:
+        using states = std::array<cpp::bounds_state,sizeof...(BOUNDS)>;
+
+        static const std::size_t never = static_cast<std::size_t>( -1 );
+
+        //Lo mismo que hace bounded_space_evolution_policy con cada uno de los límites:
+        template<typename PARTICLE_DATA>
+        struct bounce
+        {
+            PARTICLE_DATA& data;
+            states& state;
+
+            template<typename B>
+            void operator()( std::size_t i , const B& bounds )
+            {
+                auto collision_data = bounds( data.position() );
+
+                if( state[i] == cpp::bounds_state::inside && collision_data.state == cpp::bounds_state::outside )
+                {
+                    auto input_direction  = data.speed().normalized();
+                    auto output_direction = input_direction.reflexion( collision_data.bounds_normal );
+
+                    data.speed() = data.speed().length() * output_direction;
+                }
+
+                state[i] = collision_data.state;
+            }
+        };
+
+        struct first_crossing
+        {
+            dl32::vector_2df position , speed;
+            float margin , time;
+
+            template<typename B>
+            void operator()( std::size_t , const B& bounds )
+            {
+                time = std::min( time , cpp::crossing_time( bounds , position , speed , margin ) );
+            }
+        };
+
+        template<typename PARTICLE_DATA>
+        void process( PARTICLE_DATA& data , std::size_t index )
+        {
+            bounce<PARTICLE_DATA> f{ data , _states[index] };
+            impl::tuple_for_each<0,sizeof...(BOUNDS)>::apply( _bounds , f );
+
+            _events++;
+        }
+
+        template<typename PARTICLE_DATA>
+        void schedule( const PARTICLE_DATA& data , std::size_t index )
+        {
+            const float infinity = std::numeric_limits<float>::infinity();
+
+            first_crossing exact{ data.position() , data.speed() , 0.0f , infinity };
+            impl::tuple_for_each<0,sizeof...(BOUNDS)>::apply( _bounds , exact );
+
+            if( !( exact.time < infinity ) )
+            {
+                _due[index] = never;
+                return;
+            }
+
+            //Las posiciones se acumulan frame a frame, y cada suma puede perder medio ulp de cada coordenada. La partícula se
+            //procesa cuando puede estar a menos de ese error acumulado del borde (Si se procesa antes de tiempo, simplemente se
+            //vuelve a programar; al rozar un borde, esto es lo que evita llegar tarde):
+            float ulp = std::max( std::fabs( data.position().x ) , std::fabs( data.position().y ) ) * std::numeric_limits<float>::epsilon();
+
+            first_crossing safe{ data.position() , data.speed() , ( exact.time + 1.0f ) * ulp * 2.0f , infinity };
+            impl::tuple_for_each<0,sizeof...(BOUNDS)>::apply( _bounds , safe );
+
+            //Si la velocidad crece un factor g por frame, en k frames se recorre speed * (g + g^2 + ... + g^k):
+            float frames = safe.time;
+
+            if( _max_speed_growth > 1.0f )
+                frames = std::log( 1.0f + frames * ( _max_speed_growth - 1.0f ) / _max_speed_growth ) / std::log( _max_speed_growth );
+
+            std::size_t delay = static_cast<std::size_t>( std::floor( std::min( frames , 1e9f ) ) );
+
+            _due[index] = _frame + std::max<std::size_t>( delay , 1u );
+            _wheel[_due[index] % wheel_size].push_back( static_cast<std::uint32_t>( index ) );
+        }
+
+        template<typename ITERATOR>
+        void reschedule_all( ITERATOR first , std::size_t count )
+        {
+            std::vector<states> old_states;
+            old_states.swap( _states );
+
+            for( auto& bucket : _wheel )
+                bucket.clear();
+
+            _due.assign( count , never );
+            _states.resize( count );
+
+            for( std::size_t i = 0 ; i < count ; ++i )
+            {
+                //Las partículas nuevas empiezan sin estado (Como en bounded_space_evolution_policy):
+                if( i < old_states.size() )
+                    _states[i] = old_states[i];
+                else
+                    _states[i].fill( cpp::bounds_state::unknown );
+
+                process( first[i] , i );
+                schedule( first[i] , i );
+            }
+        }
+
+        std::tuple<BOUNDS...> _bounds;
+        float _max_speed_growth = 1.0f;
+
+        std::size_t _frame = 0 , _events = 0;
+        std::vector<std::vector<std::uint32_t>> _wheel;
+        std::vector<std::uint32_t> _current;
+        std::vector<std::size_t> _due;
+        std::vector<states> _states;
+    };
+
+    template<typename... BOUNDS>
+    const std::size_t predictive_bounds_policy<BOUNDS...>::wheel_size;
+
+    template<typename... BOUNDS>
+    const std::size_t predictive_bounds_policy<BOUNDS...>::never;
+
+    template<typename... BOUNDS>
+    cpp::predictive_bounds_policy<typename std::decay<BOUNDS>::type...> make_predictive_bounds_policy( BOUNDS&&... bounds )
+    {
+        return cpp::predictive_bounds_policy<typename std::decay<BOUNDS>::type...>{ std::forward<BOUNDS>( bounds )... };
+    }
 }
 
 #endif	/* SPACE_EVOLUTION_POLICIES_HPP */
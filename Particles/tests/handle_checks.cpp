@@ -0,0 +1,237 @@
+/****************************************************************************
+* Snippets, ejemplos, y utilidades del curso de C++ orientado a videojuegos *
+* https://github.com/Manu343726/CppVideojuegos/                             *
+*                                                                           *
+* Copyright © 2014 Manuel Sánchez Pérez                                     *
+*                                                                           *
+* This program is free software. It comes without any warranty, to          *
+* the extent permitted by applicable law. You can redistribute it           *
+* and/or modify it under the terms of the Do What The Fuck You Want         *
+* To Public License, Version 2, as published by Sam Hocevar. See            *
+* http://www.wtfpl.net/  and the COPYING file for more details.             *
+****************************************************************************/
+
+/* Comprobaciones de los handles (Ver slot_map.hpp): Un handle sigue apuntando al mismo elemento aunque éste cambie de
+ * sitio (Borrados con swap-remove, permutaciones, el reorden de Morton de los grupos), y deja de valer en cuanto su
+ * elemento se borra, aunque su slot se reutilice después.
+ *
+ * La salida sigue el formato de los tests simples de NetBeans (make test). El programa devuelve 1 si falla algo.
+ */
+
+#include "../particle_data_policies.hpp"
+#include "../particle_evolution_policies.hpp"
+#include "../type_erased_evolution_policy.hpp"
+#include "../particle_drawing_policies.hpp"
+#include "../particle_group.hpp"
+#include "../../snippets/slot_map.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+    bool failed = false;
+
+    void check( bool condition , const char* test , const std::string& message )
+    {
+        if( !condition )
+        {
+            std::cout << "%TEST_FAILED% time=0 testname=" << test << " (handle_checks) message=" << message << std::endl;
+            failed = true;
+        }
+    }
+
+    template<typename TEST>
+    void run( const char* name , TEST test )
+    {
+        std::cout << "%TEST_STARTED% " << name << " (handle_checks)" << std::endl;
+        test( name );
+        std::cout << "%TEST_FINISHED% time=0 " << name << " (handle_checks)" << std::endl;
+    }
+
+    //Todos los handles vivos apuntan a su valor (Cada valor guarda el número con el que se insertó):
+    bool handles_match( const cpp::slot_map<int>& map , const std::vector<cpp::slot_handle>& handles , const std::vector<bool>& erased )
+    {
+        for( std::size_t i = 0 ; i < handles.size() ; ++i )
+        {
+            const int* value = map.find( handles[i] );
+
+            if( erased[i] ? value != nullptr : ( value == nullptr || *value != static_cast<int>( i ) ) )
+                return false;
+        }
+
+        return true;
+    }
+}
+
+//Borrar sube la generación del slot: El handle viejo se rechaza aunque el slot se reutilice, y el elemento que ocupa
+//su sitio (swap-remove) se sigue encontrando con su handle:
+void slot_map_generations( const char* test )
+{
+    cpp::slot_map<int> map;
+    std::vector<cpp::slot_handle> handles;
+    std::vector<bool> erased( 8u , false );
+
+    for( int i = 0 ; i < 8 ; ++i )
+        handles.push_back( map.insert( i ) );
+
+    //Borrar el primero mueve el último a su sitio:
+    check( map.erase( handles[0] ) , test , "could not erase a live handle" );
+    erased[0] = true;
+
+    check( !map.contains( handles[0] ) , test , "erased handle still contained" );
+    check( map.find( handles[0] ) == nullptr , test , "erased handle still found" );
+    check( !map.erase( handles[0] ) , test , "erased the same handle twice" );
+    check( map.size() == 7u , test , "wrong size after erase" );
+    check( map.index_of( handles[7] ) == 0u , test , "last element was not swapped into the erased position" );
+    check( map.handle_of( 0u ) == handles[7] , test , "swapped element has a different handle" );
+    check( handles_match( map , handles , erased ) , test , "handles broken by a swap-remove" );
+
+    //Por posición (Como borran los grupos):
+    std::size_t position = map.index_of( handles[3] );
+    map.erase_at( position );
+    erased[3] = true;
+
+    check( !map.contains( handles[3] ) , test , "handle erased by position still contained" );
+    check( handles_match( map , handles , erased ) , test , "handles broken by erase_at()" );
+
+    //El slot libre se reutiliza con otra generación:
+    cpp::slot_handle reused = map.insert( 100 );
+    bool same_slot = reused.index == handles[0].index || reused.index == handles[3].index;
+
+    check( same_slot , test , "freed slot was not reused" );
+    check( reused.generation != ( reused.index == handles[0].index ? handles[0] : handles[3] ).generation , test ,
+           "reused slot kept its old generation" );
+    check( !( reused == handles[0] ) && !( reused == handles[3] ) , test , "new handle equals an erased one" );
+    check( map.find( reused ) && *map.find( reused ) == 100 , test , "new handle does not find its value" );
+    check( handles_match( map , handles , erased ) , test , "stale handle accepted after slot reuse" );
+
+    check( !map.contains( cpp::slot_handle{} ) , test , "null handle contained" );
+}
+
+//Una permutación cualquiera mueve los elementos, no los handles:
+void slot_map_permute( const char* test )
+{
+    cpp::slot_map<int> map;
+    std::vector<cpp::slot_handle> handles;
+    std::vector<bool> erased( 200u , false );
+
+    for( int i = 0 ; i < 200 ; ++i )
+        handles.push_back( map.insert( i ) );
+
+    //Con algún hueco en la tabla de slots:
+    for( int i = 0 ; i < 200 ; i += 7 )
+    {
+        map.erase( handles[i] );
+        erased[i] = true;
+    }
+
+    std::vector<std::size_t> order( map.size() );
+
+    for( std::size_t i = 0 ; i < order.size() ; ++i )
+        order[i] = i;
+
+    std::mt19937 prng;
+    std::shuffle( std::begin( order ) , std::end( order ) , prng );
+
+    std::vector<int> expected( map.size() );
+
+    for( std::size_t i = 0 ; i < order.size() ; ++i )
+        expected[i] = *( std::begin( map ) + order[i] );
+
+    map.permute( order );
+
+    check( std::equal( std::begin( map ) , std::end( map ) , std::begin( expected ) ) , test , "elements not permuted" );
+    check( handles_match( map , handles , erased ) , test , "handles broken by permute()" );
+
+    bool consistent = true;
+
+    for( std::size_t i = 0 ; i < map.size() ; ++i )
+        consistent = consistent && map.index_of( map.handle_of( i ) ) == i;
+
+    check( consistent , test , "handle_of() and index_of() disagree after permute()" );
+}
+
+void handle_table_clear( const char* test )
+{
+    cpp::handle_table table;
+    std::vector<cpp::slot_handle> handles;
+
+    for( int i = 0 ; i < 16 ; ++i )
+        handles.push_back( table.insert() );
+
+    table.clear();
+
+    bool any = false;
+
+    for( auto& handle : handles )
+        any = any || table.contains( handle );
+
+    check( !any , test , "handle still valid after clear()" );
+
+    cpp::slot_handle reused = table.insert();
+
+    check( table.contains( reused ) && table.index( reused ) == 0u , test , "table unusable after clear()" );
+    check( !table.contains( handles[reused.index] ) , test , "old handle accepted by a reused slot after clear()" );
+}
+
+//El reorden de Morton de un grupo cambia las partículas de sitio, pero cada handle sigue apuntando a la suya:
+void group_reorder( const char* test )
+{
+    using data_t = cpp::default_particle_data_holder;
+
+    cpp::particle_group<data_t,cpp::evolution_policies_pipeline<data_t>,cpp::pixel_particle_drawing_policy> group;
+
+    std::mt19937 prng;
+    std::uniform_real_distribution<float> coordinate{ 0.0f , 800.0f };
+
+    std::vector<cpp::slot_handle> handles;
+    std::vector<dl32::vector_2df> positions;
+
+    for( int i = 0 ; i < 2000 ; ++i )
+    {
+        dl32::vector_2df position{ coordinate( prng ) , coordinate( prng ) };
+
+        handles.push_back( group.add( data_t{ position , dl32::vector_2df{} , sf::Color::White } ) );
+        positions.push_back( position );
+    }
+
+    group.reorder();
+
+    bool moved = false , found = true;
+
+    for( std::size_t i = 0 ; i < handles.size() ; ++i )
+    {
+        auto it = group.find( handles[i] );
+
+        if( it == std::end( group ) )
+        {
+            found = false;
+            continue;
+        }
+
+        moved = moved || group.index_of( handles[i] ) != i;
+        found = found && it->position() == positions[i] && group.handle_of( group.index_of( handles[i] ) ) == handles[i];
+    }
+
+    check( moved , test , "reorder() did not move any particle" );
+    check( found , test , "handle points to another particle after reorder()" );
+}
+
+int main()
+{
+    std::cout << "%SUITE_STARTING% handle_checks" << std::endl;
+    std::cout << "%SUITE_STARTED%" << std::endl;
+
+    run( "slot_map_generations" , slot_map_generations );
+    run( "slot_map_permute" , slot_map_permute );
+    run( "handle_table_clear" , handle_table_clear );
+    run( "group_reorder" , group_reorder );
+
+    std::cout << "%SUITE_FINISHED% time=0" << std::endl;
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,901 @@
+/****************************************************************************
+* Snippets, ejemplos, y utilidades del curso de C++ orientado a videojuegos *
+* https://github.com/Manu343726/CppVideojuegos/                             *
+*                                                                           *
+* Copyright © 2014 Manuel Sánchez Pérez                                     *
+*                                                                           *
+* This program is free software. It comes without any warranty, to          *
+* the extent permitted by applicable law. You can redistribute it           *
+* and/or modify it under the terms of the Do What The Fuck You Want         *
+* To Public License, Version 2, as published by Sam Hocevar. See            *
+* http://www.wtfpl.net/  and the COPYING file for more details.             *
+****************************************************************************/
+
+/* Comprobaciones de las políticas de evolución, y de la maquinaria que las ejecuta (Grupos, pipelines, policy erasure),
+ * en lo que no se ve funcionar en la demo. Cada una compara con una versión directa (Lenta, pero obviamente correcta).
+ *
+ * La salida sigue el formato de los tests simples de NetBeans (make test). El programa devuelve 1 si falla algo.
+ */
+
+#include "../particle_data_policies.hpp"
+#include "../particle_evolution_policies.hpp"
+#include "../gravity_evolution_policies.hpp"
+#include "../field_evolution_policies.hpp"
+#include "../space_evolution_policies.hpp"
+#include "../type_erased_evolution_policy.hpp"
+#include "../particle_drawing_policies.hpp"
+#include "../particle_group.hpp"
+#include "../fireworks.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+    bool failed = false;
+
+    void check( bool condition , const char* test , const std::string& message )
+    {
+        if( !condition )
+        {
+            std::cout << "%TEST_FAILED% time=0 testname=" << test << " (policy_checks) message=" << message << std::endl;
+            failed = true;
+        }
+    }
+
+    template<typename TEST>
+    void run( const char* name , TEST test )
+    {
+        std::cout << "%TEST_STARTED% " << name << " (policy_checks)" << std::endl;
+        test( name );
+        std::cout << "%TEST_FINISHED% time=0 " << name << " (policy_checks)" << std::endl;
+    }
+
+    using particles = std::vector<cpp::default_particle_data_holder>;
+
+    particles random_particles( std::size_t count , std::mt19937& prng )
+    {
+        std::normal_distribution<float> distribution{ 0.0f , 100.0f };
+        particles result;
+
+        for( std::size_t i = 0 ; i < count ; ++i )
+            result.push_back( cpp::default_particle_data_holder{ dl32::vector_2df{ 400.0f + distribution( prng ) , 300.0f + distribution( prng ) } ,
+                                                                 dl32::vector_2df{ 0.0f , 0.0f } ,
+                                                                 sf::Color::White } );
+
+        return result;
+    }
+
+    /* Con opening_angle = 0 no se aproxima ninguna celda: Barnes-Hut tiene que dar lo mismo que sumar todas las parejas
+     * (Salvo el orden de las sumas). Incluye partículas repetidas, que acaban en la misma hoja a la máxima profundidad.
+     */
+    void barnes_hut_exact( const char* test )
+    {
+        const float strength = 0.001f , softening = 2.0f;
+
+        std::mt19937 prng;
+        particles input = random_particles( 2000u , prng );
+        input.push_back( input[5] );
+        input.push_back( input[5] );
+
+        particles expected = input;
+
+        for( std::size_t i = 0 ; i < input.size() ; ++i )
+        {
+            dl32::vector_2df acceleration;
+
+            for( std::size_t j = 0 ; j < input.size() ; ++j )
+            {
+                if( i == j )
+                    continue;
+
+                dl32::vector_2df distance = input[j].position() - input[i].position();
+                float inverse = 1.0f / std::sqrt( distance * distance + softening * softening );
+
+                acceleration += distance * ( inverse * inverse * inverse );
+            }
+
+            expected[i].speed() += acceleration * strength;
+        }
+
+        cpp::thread_pool pool{ 4u };
+        cpp::barnes_hut_gravity_policy gravity{ strength , 0.0f , softening , pool };
+        particles result = input;
+
+        gravity( std::begin( result ) , std::end( result ) );
+
+        for( std::size_t i = 0 ; i < result.size() ; ++i )
+        {
+            float error = ( result[i].speed() - expected[i].speed() ).length();
+
+            if( error > 1e-4f * expected[i].speed().length() + 1e-7f )
+            {
+                std::ostringstream message;
+                message << "particle " << i << " differs from brute force by " << error;
+                check( false , test , message.str() );
+                break;
+            }
+        }
+    }
+
+    cpp::aabb_2d<float> field_area()
+    {
+        return cpp::aabb_2d<float>::from_coords_and_size( 0.0f , 0.0f , 800.0f , 600.0f );
+    }
+
+    /* El muestreo por lotes (SSE2 si está disponible, con el final del lote en escalar) tiene que dar lo mismo que
+     * muestrear partícula a partícula, también fuera del área del campo. Un número de puntos que no es múltiplo de 4
+     * para pasar por el final escalar.
+     */
+    void field_batch_sample( const char* test )
+    {
+        cpp::vector_field field{ field_area() , 161u , 121u };
+
+        field.add_source( cpp::field_sources::turbulence( 80.0f , 0.01f , 7u ) );
+        field.add_source( cpp::field_sources::attractor( dl32::vector_2df{ 400.0f , 300.0f } , 0.05f , 150.0f ) ,
+                          cpp::aabb_2d<float>::from_coords_and_size( 250.0f , 150.0f , 300.0f , 300.0f ) );
+        field.rebuild();
+
+        std::mt19937 prng;
+        std::uniform_real_distribution<float> distribution_x{ -50.0f , 850.0f } , distribution_y{ -50.0f , 650.0f };
+        std::vector<float> x( 10003u ) , y( 10003u ) , out_x( 10003u ) , out_y( 10003u );
+
+        for( std::size_t i = 0 ; i < x.size() ; ++i )
+        {
+            x[i] = distribution_x( prng );
+            y[i] = distribution_y( prng );
+        }
+
+        field.sample( x.data() , y.data() , out_x.data() , out_y.data() , x.size() );
+
+        for( std::size_t i = 0 ; i < x.size() ; ++i )
+        {
+            dl32::vector_2df expected = field.sample( dl32::vector_2df{ x[i] , y[i] } ) ,
+                             result{ out_x[i] , out_y[i] };
+            float error = ( result - expected ).length();
+
+            if( error > 1e-4f * expected.length() + 1e-6f )
+            {
+                std::ostringstream message;
+                message << "point (" << x[i] << "," << y[i] << ") differs from the scalar sample by " << error;
+                check( false , test , message.str() );
+                break;
+            }
+        }
+    }
+
+    /* Después de cambiar y quitar fuentes, rebuild() sólo recalcula los nodos afectados. El campo tiene que quedar
+     * exactamente igual que uno construido desde cero con las fuentes finales (Las sumas se hacen en el mismo orden).
+     */
+    void field_incremental_rebuild( const char* test )
+    {
+        cpp::vector_field field{ field_area() , 161u , 121u } , expected{ field_area() , 161u , 121u };
+
+        field.add_source( cpp::field_sources::turbulence( 80.0f , 0.01f , 7u ) );
+        auto attractor = field.add_source( cpp::field_sources::attractor( dl32::vector_2df{ 400.0f , 300.0f } , 0.05f , 150.0f ) ,
+                                           cpp::aabb_2d<float>::from_coords_and_size( 250.0f , 150.0f , 300.0f , 300.0f ) );
+        auto wind = field.add_source( cpp::field_sources::wind( dl32::vector_2df{ 0.01f , 0.0f } ) ,
+                                      cpp::aabb_2d<float>::from_coords_and_size( 0.0f , 0.0f , 200.0f , 600.0f ) );
+        field.rebuild();
+
+        field.update_source( attractor , cpp::field_sources::attractor( dl32::vector_2df{ 300.0f , 200.0f } , 0.05f , 100.0f ) ,
+                             cpp::aabb_2d<float>::from_coords_and_size( 200.0f , 100.0f , 200.0f , 200.0f ) );
+        field.remove_source( wind );
+        field.rebuild();
+
+        expected.add_source( cpp::field_sources::turbulence( 80.0f , 0.01f , 7u ) );
+        expected.add_source( cpp::field_sources::attractor( dl32::vector_2df{ 300.0f , 200.0f } , 0.05f , 100.0f ) ,
+                             cpp::aabb_2d<float>::from_coords_and_size( 200.0f , 100.0f , 200.0f , 200.0f ) );
+        expected.rebuild();
+
+        check( !field.dirty() , test , "the field is still dirty after rebuild()" );
+
+        for( std::size_t row = 0 ; row < field.rows() ; ++row )
+            for( std::size_t column = 0 ; column < field.columns() ; ++column )
+            {
+                dl32::vector_2df node = field.node_position( column , row ) ,
+                                 a    = field.sample( node ) ,
+                                 b    = expected.sample( node );
+
+                if( a.x != b.x || a.y != b.y )
+                {
+                    std::ostringstream message;
+                    message << "node (" << column << "," << row << ") differs from a full rebuild";
+                    check( false , test , message.str() );
+                    return;
+                }
+            }
+    }
+
+    //Distancia con signo exacta a un conjunto de polígonos (Negativa dentro de alguno, por la regla par-impar):
+    float polygons_distance( const std::vector<cpp::polygon_bounds::polygon>& polygons , const dl32::vector_2df& point )
+    {
+        float best = std::numeric_limits<float>::max();
+        bool inside = false;
+
+        for( auto& vertices : polygons )
+        {
+            bool inside_polygon = false;
+
+            for( std::size_t i = 0 , j = vertices.size() - 1 ; i < vertices.size() ; j = i++ )
+            {
+                dl32::vector_2df a = vertices[j] , b = vertices[i] , edge = b - a;
+                float t = std::min( std::max( ( ( point - a ) * edge ) / ( edge * edge ) , 0.0f ) , 1.0f );
+
+                best = std::min( best , ( point - ( a + edge * t ) ).length() );
+
+                if( ( a.y > point.y ) != ( b.y > point.y ) && point.x < a.x + ( point.y - a.y ) / ( b.y - a.y ) * edge.x )
+                    inside_polygon = !inside_polygon;
+            }
+
+            inside = inside || inside_polygon;
+        }
+
+        return inside ? -best : best;
+    }
+
+    bool near_vertex( const std::vector<cpp::polygon_bounds::polygon>& polygons , const dl32::vector_2df& point , float radius )
+    {
+        for( auto& vertices : polygons )
+            for( auto& vertex : vertices )
+                if( ( point - vertex ).length() < radius )
+                    return true;
+
+        return false;
+    }
+
+    /* El campo de distancias interpolado tiene que parecerse a la distancia exacta: El error de la interpolación es de
+     * como mucho una celda, así que a más de una celda y media del borde el estado (Dentro/fuera) tiene que ser el
+     * correcto. Cerca del borde (Que es donde se rebota) el punto de colisión tiene que estar sobre él, y la normal
+     * apuntar hacia dentro de los polígonos. Eso no vale cerca de los vértices, ni lejos del borde: Donde dos lados están
+     * a la misma distancia el gradiente interpolado es una mezcla de los dos.
+     */
+    void polygon_bounds_distance( const char* test )
+    {
+        const float cell_size = 2.0f;
+
+        std::vector<cpp::polygon_bounds::polygon> polygons;
+        cpp::polygon_bounds::polygon star;
+
+        for( int i = 0 ; i < 10 ; ++i )
+        {
+            float angle = i * 3.14159265f / 5.0f , radius = ( i % 2 ) ? 40.0f : 100.0f;
+
+            star.push_back( dl32::vector_2df{ 400.0f + radius * std::cos( angle ) , 300.0f + radius * std::sin( angle ) } );
+        }
+
+        polygons.push_back( star );
+        polygons.push_back( cpp::polygon_bounds::polygon{ { 100.0f , 100.0f } , { 200.0f , 100.0f } , { 200.0f , 150.0f } , { 100.0f , 150.0f } } );
+
+        cpp::polygon_bounds bounds{ polygons , field_area() , cell_size };
+
+        std::mt19937 prng;
+        std::uniform_real_distribution<float> distribution_x{ 0.0f , 800.0f } , distribution_y{ 0.0f , 600.0f };
+
+        for( int i = 0 ; i < 100000 ; ++i )
+        {
+            dl32::vector_2df point{ distribution_x( prng ) , distribution_y( prng ) };
+
+            float exact = polygons_distance( polygons , point ) ,
+                  distance = bounds.distance( point );
+            auto collision = bounds( point );
+
+            std::ostringstream message;
+            message << "point (" << point.x << "," << point.y << "): ";
+
+            if( std::fabs( distance - exact ) > cell_size )
+                message << "distance " << distance << " instead of " << exact;
+            else if( std::fabs( exact ) > 1.5f * cell_size && ( collision.state == cpp::bounds_state::inside ) != ( exact < 0.0f ) )
+                message << "wrong state";
+            else if( std::fabs( exact ) >= cell_size || near_vertex( polygons , point , 4.0f * cell_size ) )
+                continue;
+            else if( std::fabs( polygons_distance( polygons , collision.collision_point ) ) > 0.5f * cell_size )
+                message << "collision point off the boundary";
+            else if( polygons_distance( polygons , point + collision.bounds_normal * ( 0.25f * cell_size ) ) >= exact )
+                message << "normal doesn't point inwards";
+            else
+                continue;
+
+            check( false , test , message.str() );
+            break;
+        }
+
+        //Invertidos (Los polígonos como obstáculos) cambian el estado y la normal:
+        auto obstacles = bounds.inversed();
+        dl32::vector_2df point{ 150.0f , 160.0f };
+
+        check( obstacles( point ).state == cpp::bounds_state::inside , test , "inverse bounds: wrong state" );
+        check( obstacles( point ).bounds_normal * bounds( point ).bounds_normal < 0.0f , test , "inverse bounds: normal not flipped" );
+    }
+
+    using scheduled_bounds = cpp::predictive_bounds_policy<cpp::inverse_bounds<cpp::circle_bounds>,cpp::rectangle_bounds>;
+
+    //Los rebotes programados, y después algo más que acelera las partículas (Como una etapa del pipeline al final):
+    struct accelerated_scheduled_bounds
+    {
+        scheduled_bounds bounds;
+        float growth;
+
+        template<typename ITERATOR>
+        void operator()( ITERATOR first , ITERATOR last )
+        {
+            bounds( first , last );
+
+            for( ; first != last ; ++first )
+                first->speed() *= growth;
+        }
+
+        void permute( const std::vector<std::size_t>& order )
+        {
+            bounds.permute( order );
+        }
+    };
+
+    /* Los rebotes programados de antemano tienen que ser exactamente los mismos que comprobando los límites de cada
+     * partícula en cada frame: Mismas posiciones y velocidades (Bit a bit) durante 3000 frames, reordenando las
+     * partículas por el camino. Con y sin aceleración (Ver max_speed_growth()).
+     */
+    void predictive_bounds_identical( const char* test , float growth )
+    {
+        auto circle = cpp::inverse_bounds<cpp::circle_bounds>{ dl32::vector_2df{ 400.0f , 300.0f } , 300.0f };
+        auto rectangle = cpp::rectangle_bounds{ field_area() };
+
+        cpp::evolution_policies_pipeline<cpp::default_particle_data_holder> pipeline;
+        pipeline.add_stage( cpp::make_bounds_policy( circle ) );
+        pipeline.add_stage( cpp::make_bounds_policy( rectangle ) );
+        pipeline.add_stage( [=]( cpp::default_particle_data_holder& data ){ data.speed() *= growth; } );
+
+        cpp::particle_group<cpp::default_particle_data_holder,
+                            cpp::evolution_policies_pipeline<cpp::default_particle_data_holder>,
+                            cpp::pixel_particle_drawing_policy> expected{ pipeline };
+        cpp::particle_group<cpp::default_particle_data_holder,
+                            accelerated_scheduled_bounds,
+                            cpp::pixel_particle_drawing_policy> result{ accelerated_scheduled_bounds{ cpp::make_predictive_bounds_policy( circle , rectangle ) , growth } };
+
+        result.evolution_policy().bounds.max_speed_growth( growth );
+
+        std::mt19937 prng;
+        std::uniform_real_distribution<float> distribution{ 0.0f , 2.0f * 3.141592654f };
+
+        for( int i = 0 ; i < 20000 ; ++i )
+        {
+            float angle = distribution( prng );
+            cpp::default_particle_data_holder particle{ dl32::vector_2df{ 400.0f , 300.0f } ,
+                                                        dl32::vector_2df{ 0.6f * std::cos( angle ) , 0.6f * std::sin( angle ) } ,
+                                                        sf::Color::White };
+
+            expected.add( particle );
+            result.add( particle );
+        }
+
+        for( int frame = 0 ; frame < 3000 ; ++frame )
+        {
+            expected.step();
+            result.step();
+
+            if( frame == 2000 )
+            {
+                expected.reorder();
+                result.reorder();
+            }
+
+            for( std::size_t i = 0 ; i < expected.size() ; ++i )
+            {
+                const auto& a = *( expected.begin() + i );
+                const auto& b = *( result.begin() + i );
+
+                if( a.position().x != b.position().x || a.position().y != b.position().y ||
+                    a.speed().x != b.speed().x || a.speed().y != b.speed().y )
+                {
+                    std::ostringstream message;
+                    message << "particle " << i << " differs at frame " << frame;
+                    check( false , test , message.str() );
+                    return;
+                }
+            }
+        }
+    }
+
+    void predictive_bounds_constant_speed( const char* test )
+    {
+        predictive_bounds_identical( test , 1.0f );
+    }
+
+    void predictive_bounds_growing_speed( const char* test )
+    {
+        predictive_bounds_identical( test , 1.0001f );
+    }
+
+    std::vector<sf::Vertex> draw( const cpp::fireworks::team& team )
+    {
+        std::vector<sf::Vertex> vertices;
+        team.draw( vertices );
+
+        return vertices;
+    }
+
+    /* Un equipo de fuegos artificiales con un número limitado de oleadas se queda inactivo después de la última, y sus
+     * partículas (Paradas) se duermen. Dormidas se tienen que seguir dibujando igual. Sin límite no se duermen nunca.
+     */
+    void fireworks_last_wave_sleeps( const char* test )
+    {
+        const int lifetime = 50 , waves = 2;
+
+        auto finite   = std::make_shared<cpp::fireworks::lifetime_policy>( lifetime , dl32::vector_2df{ 400.0f , 300.0f } , 0.05f , 1.0003f , 0.9997f , 0.3f , 0.6f , waves );
+        auto infinite = std::make_shared<cpp::fireworks::lifetime_policy>( lifetime , dl32::vector_2df{ 400.0f , 300.0f } , 0.05f , 1.0003f , 0.9997f );
+
+        cpp::fireworks::team last{ finite , cpp::make_derived_color_drawing_policy( cpp::fireworks::phase_color{ finite } ) } ,
+                             endless{ infinite , cpp::make_derived_color_drawing_policy( cpp::fireworks::phase_color{ infinite } ) };
+
+        last.add( cpp::fireworks::particle{} , 1000u );
+        endless.add( cpp::fireworks::particle{} , 1000u );
+
+        std::vector<sf::Vertex> parked;
+
+        for( int frame = 0 ; frame < 4 * lifetime ; ++frame )
+        {
+            last.step();
+            endless.step();
+
+            check( endless.sleeping() == 0u , test , "an endless team fell asleep" );
+
+            //Lo último que dibujan despiertas (Ya paradas después de la última muerte):
+            if( last.sleeping() == 0u )
+                parked = draw( last );
+        }
+
+        check( last.sleeping() == last.size() , test , "the team doesn't sleep after its last wave" );
+
+        std::vector<sf::Vertex> asleep = draw( last );
+
+        check( !parked.empty() && asleep.size() == parked.size() &&
+               std::equal( std::begin( asleep ) , std::end( asleep ) , std::begin( parked ) , []( const sf::Vertex& a , const sf::Vertex& b )
+               {
+                   return a.position == b.position && a.color == b.color;
+               }) ,
+               test , "sleeping particles draw something else" );
+
+        cpp::fireworks::fireworks_engine engine{ lifetime , dl32::vector_2df{ 400.0f , 300.0f } , 0.05f , waves };
+
+        for( int frame = 0 ; frame < 4 * lifetime ; ++frame )
+            engine.step();
+
+        check( engine.sleeping() == 4000u , test , "the engine doesn't sleep after its last wave" );
+    }
+
+    std::vector<sf::Vertex> draw_buffered( const cpp::fireworks::team& team , const cpp::aabb_2d<float>& viewport )
+    {
+        std::vector<sf::Vertex> vertices;
+        team.draw_buffered( viewport , [&]( std::vector<sf::Vertex>::const_iterator first , std::vector<sf::Vertex>::const_iterator last )
+        {
+            vertices.insert( std::end( vertices ) , first , last );
+        });
+
+        return vertices;
+    }
+
+    /* El buffer de vértices de un grupo sólo se regenera en los bloques en los que algo ha cambiado. Un equipo de fuegos
+     * artificiales tiene de todo: Partículas que nacen en otro sitio, que se paran al morir (Y cambian de color sin moverse
+     * más), y que se duermen. Lo que se dibuja desde el buffer tiene que ser siempre lo mismo que dibujarlas de nuevo.
+     */
+    void fireworks_buffered_draw( const char* test )
+    {
+        const int lifetime = 50 , waves = 3;
+        const auto viewport = cpp::aabb_2d<float>::from_coords_and_size( -10000.0f , -10000.0f , 20000.0f , 20000.0f );
+
+        auto policy = std::make_shared<cpp::fireworks::lifetime_policy>( lifetime , dl32::vector_2df{ 400.0f , 300.0f } , 0.05f , 1.0003f , 0.9997f , 0.3f , 0.6f , waves );
+        cpp::fireworks::team team{ policy , cpp::make_derived_color_drawing_policy( cpp::fireworks::phase_color{ policy } ) };
+
+        team.add( cpp::fireworks::particle{} , 3000u );
+
+        for( int frame = 0 ; frame < ( waves + 1 ) * lifetime ; ++frame )
+        {
+            team.step();
+
+            std::vector<sf::Vertex> buffered = draw_buffered( team , viewport ) , drawn = draw( team );
+
+            if( buffered.size() != drawn.size() ||
+                !std::equal( std::begin( buffered ) , std::end( buffered ) , std::begin( drawn ) , []( const sf::Vertex& a , const sf::Vertex& b )
+                {
+                    return a.position == b.position && a.color == b.color;
+                }) )
+            {
+                check( false , test , "the vertex buffer is out of date" );
+                return;
+            }
+        }
+    }
+
+    //Color que no depende de la partícula, sino de algo de fuera (Como el de los equipos de fuegos artificiales):
+    struct external_color
+    {
+        std::shared_ptr<sf::Color> current;
+
+        sf::Color operator()( const cpp::default_particle_data_holder& ) const
+        {
+            return *current;
+        }
+
+        std::uint64_t generation() const
+        {
+            return ( static_cast<std::uint64_t>( current->r ) << 16 ) | ( static_cast<std::uint64_t>( current->g ) << 8 ) | current->b;
+        }
+    };
+
+    template<typename GROUP>
+    bool buffer_up_to_date( const GROUP& group )
+    {
+        const auto viewport = cpp::aabb_2d<float>::from_coords_and_size( -10000.0f , -10000.0f , 20000.0f , 20000.0f );
+
+        std::vector<sf::Vertex> buffered , drawn;
+
+        group.draw( drawn );
+        group.draw_buffered( viewport , [&]( std::vector<sf::Vertex>::const_iterator first , std::vector<sf::Vertex>::const_iterator last )
+        {
+            buffered.insert( std::end( buffered ) , first , last );
+        });
+
+        return buffered.size() == drawn.size() &&
+               std::equal( std::begin( buffered ) , std::end( buffered ) , std::begin( drawn ) , []( const sf::Vertex& a , const sf::Vertex& b )
+               {
+                   return a.position == b.position && a.color == b.color;
+               });
+    }
+
+    /* Partículas paradas que cambian de color: Porque una etapa cambia su color, o porque su color derivado depende de
+     * algo de fuera. El buffer de vértices se tiene que enterar sin que nadie se lo diga.
+     */
+    void buffered_draw_recolors( const char* test )
+    {
+        using pipeline_t = cpp::evolution_policies_pipeline<cpp::default_particle_data_holder>;
+
+        auto frame = std::make_shared<int>( 0 );
+        auto color = std::make_shared<sf::Color>( sf::Color::Red );
+
+        pipeline_t recolor , nothing;
+        recolor.add_stage( [=]( cpp::default_particle_data_holder& data )
+        {
+            if( *frame % 5 == 0 && data.position().x < 100.0f )
+                data.color() = sf::Color( static_cast<sf::Uint8>( *frame ) , 0u , 0u );
+        });
+
+        cpp::particle_group<cpp::default_particle_data_holder,pipeline_t,cpp::pixel_particle_drawing_policy> stage_colored{ recolor };
+        cpp::particle_group<cpp::default_particle_data_holder,pipeline_t,cpp::derived_color_drawing_policy<external_color>> derived{ nothing , 
+                                                                                                                                     external_color{ color } };
+
+        std::mt19937 prng{ 11u };
+
+        for( auto& particle : random_particles( 5000u , prng ) )
+        {
+            stage_colored.add( particle );
+            derived.add( particle );
+        }
+
+        bool stage_ok = true , derived_ok = true;
+
+        for( ; *frame < 30 ; ++*frame )
+        {
+            if( *frame % 7 == 0 )
+                *color = sf::Color( 0u , static_cast<sf::Uint8>( *frame ) , 0u );
+
+            stage_colored.step();
+            derived.step();
+
+            stage_ok   = stage_ok && buffer_up_to_date( stage_colored );
+            derived_ok = derived_ok && buffer_up_to_date( derived );
+        }
+
+        check( stage_ok , test , "a stage recolored stopped particles and the vertex buffer missed it" );
+        check( derived_ok , test , "the derived color changed and the vertex buffer missed it" );
+    }
+
+    //Las políticas con estado por partícula se clasifican como tales aunque también tengan step():
+    void policy_state_kinds( const char* test )
+    {
+        using data = cpp::default_particle_data_holder;
+        using bounds_policy = decltype( cpp::make_bounds_policy( cpp::rectangle_bounds{ field_area() } ) );
+        auto doubling = []( data& particle ){ particle.speed() *= 2.0f; };
+        using pure_policy = decltype( doubling );
+
+        check( cpp::policy_state_kind_of<pure_policy,data>() == cpp::policy_state_kind::pure , test , "a pure policy isn't pure" );
+        check( cpp::policy_state_kind_of<bounds_policy,data>() == cpp::policy_state_kind::per_particle , test , "bounds aren't per-particle stated" );
+        check( cpp::policy_state_kind_of<cpp::evolution_policies_pipeline<data>,data>() == cpp::policy_state_kind::per_particle , test , 
+               "the pipeline isn't per-particle stated" );
+        check( cpp::policy_state_kind_of<cpp::fireworks::shared_lifetime_policy,data>() == cpp::policy_state_kind::shared , test , 
+               "the fireworks lifetime isn't shared stated" );
+        check( cpp::fireworks::team::state_kind::value == cpp::policy_state_kind::shared && cpp::fireworks::team::has_sharded_state::value , test , 
+               "fireworks teams aren't processed in parallel" );
+    }
+
+    /* Política que cuenta sus instancias vivas, de tamaño SIZE: Con SIZE pequeño cabe en el buffer de
+     * cpp::particle_evolution_policy, con SIZE grande va al heap.
+     */
+    template<std::size_t SIZE>
+    struct counted_policy
+    {
+        static int live;
+
+        float growth;
+        char padding[SIZE];
+
+        counted_policy( float growth_ ) : growth{ growth_ }
+        {
+            live++;
+        }
+
+        counted_policy( const counted_policy& other ) : growth{ other.growth }
+        {
+            live++;
+        }
+
+        counted_policy( counted_policy&& other ) noexcept : growth{ other.growth }
+        {
+            live++;
+        }
+
+        ~counted_policy()
+        {
+            live--;
+        }
+
+        void operator()( cpp::default_particle_data_holder& data )
+        {
+            data.speed() *= growth;
+        }
+    };
+
+    template<std::size_t SIZE>
+    int counted_policy<SIZE>::live = 0;
+
+    using inline_policy = counted_policy<1u>;
+    using heap_policy   = counted_policy<4u * cpp::particle_evolution_policy<cpp::default_particle_data_holder>::buffer_size>;
+
+    //El factor de la política guardada (Lo que hace con una partícula con velocidad 1):
+    float growth_of( cpp::particle_evolution_policy<cpp::default_particle_data_holder>& policy )
+    {
+        cpp::default_particle_data_holder data{ dl32::vector_2df{ 0.0f , 0.0f } , dl32::vector_2df{ 1.0f , 0.0f } , sf::Color::White };
+        policy( data );
+
+        return data.speed().x;
+    }
+
+    /* cpp::particle_evolution_policy guarda las políticas pequeñas en su buffer y las grandes en el heap, con una vtable
+     * hecha a mano. Las copias, movimientos y asignaciones (Entre políticas de los dos tipos) tienen que conservar la
+     * política, y cada instancia se tiene que destruir exactamente una vez.
+     */
+    void type_erased_storage( const char* test )
+    {
+        using erased = cpp::particle_evolution_policy<cpp::default_particle_data_holder>;
+
+        {
+            erased small{ inline_policy{ 2.0f } } , big{ heap_policy{ 3.0f } };
+
+            check( inline_policy::live == 1 && heap_policy::live == 1 , test , "wrong number of instances after construction" );
+            check( growth_of( small ) == 2.0f && growth_of( big ) == 3.0f , test , "the erased policies don't call the stored ones" );
+
+            erased small_copy{ small } , big_copy{ big };
+
+            check( inline_policy::live == 2 && heap_policy::live == 2 , test , "copies don't copy the stored policy" );
+            check( growth_of( small_copy ) == 2.0f && growth_of( big_copy ) == 3.0f , test , "wrong copies" );
+
+            erased small_moved{ std::move( small_copy ) } , big_moved{ std::move( big_copy ) };
+
+            check( inline_policy::live == 2 && heap_policy::live == 2 , test , "moves leave extra instances" );
+            check( growth_of( small_moved ) == 2.0f && growth_of( big_moved ) == 3.0f , test , "wrong moves" );
+
+            //Asignaciones cruzadas: Cada una destruye la política que había antes
+            small_moved = big;
+
+            check( inline_policy::live == 1 && heap_policy::live == 3 , test , "copy assignment from heap to inline" );
+            check( growth_of( small_moved ) == 3.0f , test , "wrong copy assignment from heap to inline" );
+
+            big_moved = small;
+
+            check( inline_policy::live == 2 && heap_policy::live == 2 , test , "copy assignment from inline to heap" );
+            check( growth_of( big_moved ) == 2.0f , test , "wrong copy assignment from inline to heap" );
+
+            small_moved = std::move( big_moved );
+
+            check( inline_policy::live == 2 && heap_policy::live == 1 , test , "move assignment from inline to heap" );
+            check( growth_of( small_moved ) == 2.0f , test , "wrong move assignment" );
+
+            big_moved = std::move( big );
+
+            check( inline_policy::live == 2 && heap_policy::live == 1 , test , "move assignment into a moved-from policy" );
+            check( growth_of( big_moved ) == 3.0f , test , "wrong move assignment into a moved-from policy" );
+
+            erased& self = small;
+            small = self;
+
+            check( inline_policy::live == 2 && growth_of( small ) == 2.0f , test , "self assignment" );
+
+            //Un pipeline que crece mueve sus etapas (No las copia):
+            cpp::evolution_policies_pipeline<cpp::default_particle_data_holder> pipeline;
+
+            for( int i = 0 ; i < 64 ; ++i )
+            {
+                pipeline.add_stage( inline_policy{ 1.0f } );
+                pipeline.add_stage( heap_policy{ 1.0f } );
+            }
+
+            check( inline_policy::live == 66 && heap_policy::live == 65 , test , "the pipeline leaks stages while growing" );
+        }
+
+        check( inline_policy::live == 0 && heap_policy::live == 0 , test , "policies leaked or destroyed twice" );
+    }
+
+    //Etapa con estado: Cuenta cuántas veces se ha ejecutado sobre cada partícula
+    struct run_counter
+    {
+        using particle_state = int;
+
+        int initial_state() const
+        {
+            return 0;
+        }
+
+        void operator()( cpp::default_particle_data_holder& data , int& runs )
+        {
+            runs++;
+            data.position().y += 0.5f;
+        }
+    };
+
+    /* Los dos órdenes de ejecución del pipeline tienen que dar exactamente lo mismo, también con etapas con predicado
+     * (Ejecutadas a través del vector de selección en el orden por etapas) y con etapas escalonadas. Además, en un número
+     * de frames múltiplo de su periodo, cada etapa escalonada ha pasado el mismo número de veces por cada partícula.
+     */
+    void pipeline_orders_identical( const char* test )
+    {
+        using pipeline_t = cpp::evolution_policies_pipeline<cpp::default_particle_data_holder>;
+
+        const std::size_t frames = 24u;
+
+        pipeline_t pipeline;
+        pipeline.add_stage( run_counter{} , cpp::stage_update_rate::every_n_frames( 3u ) );
+        pipeline.add_stage( []( cpp::default_particle_data_holder& data ){ data.speed() *= 1.01f; } ,
+                            []( const cpp::default_particle_data_holder& data ){ return data.position().x > 400.0f; } );
+        pipeline.add_stage( run_counter{} , cpp::stage_update_rate::round_robin( 4u ) );
+        pipeline.add_stage( run_counter{} , []( const cpp::default_particle_data_holder& data ){ return data.speed().x > 0.0f; } );
+        pipeline.add_stage( []( cpp::default_particle_data_holder& data ){ data.speed().y -= 0.01f; } , cpp::stage_update_rate::round_robin( 3u ) );
+
+        pipeline_t particle_major{ pipeline } , stage_major{ pipeline };
+        particle_major.execution_order( cpp::pipeline_execution_order::particle_major );
+        stage_major.execution_order( cpp::pipeline_execution_order::stage_major );
+        stage_major.chunk_size( 64u ); //Bloques que no coinciden con los tramos de las etapas round robin
+
+        std::mt19937 prng{ 7u };
+        std::uniform_real_distribution<float> speed{ -1.0f , 1.0f };
+
+        particles by_particle = random_particles( 1003u , prng );
+
+        for( auto& particle : by_particle )
+            particle.speed() = dl32::vector_2df{ speed( prng ) , speed( prng ) };
+
+        particles by_stage = by_particle;
+
+        cpp::evolution_pipeline_state<cpp::default_particle_data_holder> particle_states , stage_states;
+        particle_states.resize( by_particle.size() , particle_major );
+        stage_states.resize( by_stage.size() , stage_major );
+
+        for( std::size_t frame = 0 ; frame < frames ; ++frame )
+        {
+            for( std::size_t i = 0 ; i < by_particle.size() ; ++i )
+            {
+                by_particle[i].position() += by_particle[i].speed();
+                by_stage[i].position()    += by_stage[i].speed();
+            }
+
+            particle_major( std::begin( by_particle ) , std::end( by_particle ) , particle_states );
+            stage_major( std::begin( by_stage ) , std::end( by_stage ) , stage_states );
+
+            particle_major.step( cpp::evolution_policy_step::global );
+            stage_major.step( cpp::evolution_policy_step::global );
+        }
+
+        bool identical = true , scheduled = true;
+
+        for( std::size_t i = 0 ; i < by_particle.size() ; ++i )
+        {
+            identical = identical && by_particle[i].position() == by_stage[i].position() && by_particle[i].speed() == by_stage[i].speed() &&
+                        *static_cast<int*>( particle_states.at( 3u , i ) ) == *static_cast<int*>( stage_states.at( 3u , i ) );
+
+            for( auto states : { &particle_states , &stage_states } )
+                scheduled = scheduled && *static_cast<int*>( states->at( 0u , i ) ) == static_cast<int>( frames / 3u ) &&
+                                         *static_cast<int*>( states->at( 2u , i ) ) == static_cast<int>( frames / 4u );
+        }
+
+        check( identical , test , "particle-major and stage-major execution differ" );
+        check( scheduled , test , "staggered stages skipped or repeated particles" );
+    }
+
+    /* Las partículas comprimidas (Ver cpp::compact_particle_data_holder) tienen que seguir la misma trayectoria que las
+     * normales, también con una etapa que cambia la velocidad muy poco en cada paso (Como la aceleración de main.cpp),
+     * y conservar su color.
+     */
+    void compact_trajectories( const char* test )
+    {
+        using pipeline_t = cpp::evolution_policies_pipeline<cpp::default_particle_data_holder>;
+
+        const dl32::vector_2df origin{ 400.0f , 300.0f };
+        const sf::Color color{ 200u , 100u , 50u };
+        const int frames = 1000 , headings = 16;
+
+        pipeline_t pipeline;
+        pipeline.add_stage( []( cpp::default_particle_data_holder& data ){ data.speed() *= 1.0001f; } );
+
+        cpp::particle_group<cpp::default_particle_data_holder,pipeline_t,cpp::pixel_particle_drawing_policy> expected{ pipeline };
+        cpp::particle_group<cpp::compact_particle_data_holder,pipeline_t,cpp::pixel_particle_drawing_policy> compact{ pipeline , cpp::pixel_particle_drawing_policy{} ,
+                                                                                                                      cpp::compact_particle_format{ origin } };
+
+        for( float speed : { 0.5f , 0.05f , 0.006f } )
+            for( int heading = 0 ; heading < headings ; ++heading )
+            {
+                float angle = 2.0f * 3.141592654f * heading / headings;
+                cpp::default_particle_data_holder particle{ origin , dl32::vector_2df{ std::cos( angle ) * speed , std::sin( angle ) * speed } , color };
+
+                expected.add( particle );
+                compact.add( particle );
+            }
+
+        for( int frame = 0 ; frame < frames ; ++frame )
+        {
+            expected.step();
+            compact.step();
+        }
+
+        float worst_position = 0.0f , worst_speed = 0.0f;
+        bool same_color = true;
+
+        for( std::size_t i = 0 ; i < expected.size() ; ++i )
+        {
+            auto reference = cpp::unpack( *( std::begin( expected ) + i ) , expected.data_format() );
+            auto packed    = cpp::unpack( *( std::begin( compact ) + i ) , compact.data_format() );
+
+            dl32::vector_2df travelled = reference.position() - origin , position_error = packed.position() - reference.position() ,
+                             speed_error = packed.speed() - reference.speed();
+
+            worst_position = std::max( worst_position , position_error.length() / travelled.length() );
+            worst_speed    = std::max( worst_speed , speed_error.length() / reference.speed().length() );
+
+            same_color = same_color && std::abs( packed.color().r - color.r ) < 8 && std::abs( packed.color().g - color.g ) < 4 &&
+                                       std::abs( packed.color().b - color.b ) < 8;
+        }
+
+        std::ostringstream message;
+        message << "compact particles drift from the float ones (Position " << worst_position << ", speed " << worst_speed << ")";
+
+        check( worst_position < 0.01f && worst_speed < 0.01f , test , message.str() );
+        check( same_color , test , "compact particles lose their color" );
+    }
+}
+
+int main()
+{
+    std::cout << "%SUITE_STARTING% policy_checks" << std::endl;
+    std::cout << "%SUITE_STARTED%" << std::endl;
+
+    run( "barnes_hut_exact" , barnes_hut_exact );
+    run( "field_batch_sample" , field_batch_sample );
+    run( "field_incremental_rebuild" , field_incremental_rebuild );
+    run( "polygon_bounds_distance" , polygon_bounds_distance );
+    run( "predictive_bounds_constant_speed" , predictive_bounds_constant_speed );
+    run( "predictive_bounds_growing_speed" , predictive_bounds_growing_speed );
+    run( "fireworks_last_wave_sleeps" , fireworks_last_wave_sleeps );
+    run( "fireworks_buffered_draw" , fireworks_buffered_draw );
+    run( "buffered_draw_recolors" , buffered_draw_recolors );
+    run( "policy_state_kinds" , policy_state_kinds );
+    run( "type_erased_storage" , type_erased_storage );
+    run( "pipeline_orders_identical" , pipeline_orders_identical );
+    run( "compact_trajectories" , compact_trajectories );
+
+    std::cout << "%SUITE_FINISHED% time=0" << std::endl;
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,221 @@
+/****************************************************************************
+* Snippets, ejemplos, y utilidades del curso de C++ orientado a videojuegos *
+* https://github.com/Manu343726/CppVideojuegos/                             *
+*                                                                           *
+* Copyright © 2014 Manuel Sánchez Pérez                                     *
+*                                                                           *
+* This program is free software. It comes without any warranty, to          *
+* the extent permitted by applicable law. You can redistribute it           *
+* and/or modify it under the terms of the Do What The Fuck You Want         *
+* To Public License, Version 2, as published by Sam Hocevar. See            *
+* http://www.wtfpl.net/  and the COPYING file for more details.             *
+****************************************************************************/
+
+/* Comprobaciones del anillo de frames en memoria compartida (Ver shared_frame_ring.hpp y frame_export.hpp): Lo que
+ * se publica es lo que leen los lectores, también desde otro proceso y mientras el productor sigue escribiendo.
+ *
+ * La salida sigue el formato de los tests simples de NetBeans (make test). El programa devuelve 1 si falla algo.
+ */
+
+#include "../frame_export.hpp"
+#include "../../snippets/shared_frame_ring.hpp"
+
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace
+{
+    bool failed = false;
+
+    void check( bool condition , const char* test , const std::string& message )
+    {
+        if( !condition )
+        {
+            std::cout << "%TEST_FAILED% time=0 testname=" << test << " (shared_frame_checks) message=" << message << std::endl;
+            failed = true;
+        }
+    }
+
+    template<typename TEST>
+    void run( const char* name , TEST test )
+    {
+        std::cout << "%TEST_STARTED% " << name << " (shared_frame_checks)" << std::endl;
+        test( name );
+        std::cout << "%TEST_FINISHED% time=0 " << name << " (shared_frame_checks)" << std::endl;
+    }
+
+    //Un nombre por proceso, para que dos ejecuciones a la vez no compartan el segmento:
+    std::string segment_name( const char* test )
+    {
+        std::ostringstream name;
+        name << "/" << test << "_" << ::getpid();
+
+        return name.str();
+    }
+
+    //Frame i: Sus partículas dicen de qué frame son, y en qué posición van:
+    void fill( cpp::shared_frame& frame , std::uint64_t i , std::size_t count )
+    {
+        for( std::size_t k = 0 ; k < count ; ++k )
+            frame.push_back( static_cast<float>( i ) , static_cast<float>( k ) , cpp::rgba{ static_cast<std::uint8_t>( i % 256u ) , 0u , 0u } );
+    }
+
+    bool consistent( const cpp::shared_frame_snapshot& snapshot , std::size_t count )
+    {
+        if( snapshot.size() != count )
+            return false;
+
+        for( std::size_t k = 0 ; k < snapshot.size() ; ++k )
+            if( snapshot.x[k] != static_cast<float>( snapshot.frame ) || snapshot.y[k] != static_cast<float>( k ) ||
+                snapshot.colors[k].r != snapshot.frame % 256u )
+                return false;
+
+        return true;
+    }
+
+    void ring_roundtrip( const char* test )
+    {
+        cpp::shared_frame_writer writer{ segment_name( test ) , 2u , 100u };
+        cpp::shared_frame_reader reader{ segment_name( test ) };
+        cpp::shared_frame_snapshot snapshot;
+
+        check( !reader.read_latest( snapshot ) , test , "read a frame before anything was published" );
+
+        auto frame = writer.begin_frame();
+        fill( frame , 1u , 100u );
+
+        check( !frame.push_back( 0.0f , 0.0f , cpp::rgba{} ) , test , "push_back() past the capacity" );
+        check( !reader.read_latest( snapshot ) , test , "read a frame before publish()" );
+
+        writer.publish( frame );
+
+        check( reader.read_latest( snapshot ) && snapshot.frame == 1u && consistent( snapshot , 100u ) , test , "wrong first frame" );
+        check( !reader.read_latest( snapshot ) , test , "read the same frame twice" );
+
+        //Un lector lento se salta los frames que ya no están en el anillo, y lee el último:
+        for( std::uint64_t i = 2u ; i <= 7u ; ++i )
+        {
+            auto next = writer.begin_frame();
+            fill( next , i , static_cast<std::size_t>( i ) );
+            writer.publish( next );
+        }
+
+        check( reader.read_latest( snapshot ) && snapshot.frame == 7u && consistent( snapshot , 7u ) , test , "wrong latest frame" );
+    }
+
+    /* El lector (Otro proceso) lee mientras el productor escribe 20000 frames en un anillo de tres: Nunca puede ver un
+     * frame a medio escribir, ni uno anterior al último que leyó.
+     */
+    void ring_concurrent_reader( const char* test )
+    {
+        const std::uint64_t frames = 20000u;
+        const std::size_t capacity = 5000u;
+
+        const std::string name = segment_name( test );
+
+        cpp::shared_frame_writer writer{ name , 3u , capacity };
+        pid_t reader_process = ::fork();
+
+        if( reader_process == 0 )
+        {
+            cpp::shared_frame_reader reader{ name };
+            cpp::shared_frame_snapshot snapshot;
+            std::uint64_t last = 0;
+
+            while( last < frames )
+            {
+                if( !reader.read_latest( snapshot ) )
+                    continue;
+
+                if( snapshot.frame <= last || !consistent( snapshot , snapshot.frame % capacity ) )
+                    ::_exit( 1 );
+
+                last = snapshot.frame;
+            }
+
+            ::_exit( 0 );
+        }
+
+        check( reader_process > 0 , test , "fork() failed" );
+
+        if( reader_process < 0 )
+            return;
+
+        for( std::uint64_t i = 1u ; i <= frames ; ++i )
+        {
+            auto frame = writer.begin_frame();
+            fill( frame , i , static_cast<std::size_t>( i % capacity ) );
+            writer.publish( frame );
+        }
+
+        int status = 0;
+        ::waitpid( reader_process , &status , 0 );
+
+        check( WIFEXITED( status ) && WEXITSTATUS( status ) == 0 , test , "the reader saw a torn or stale frame" );
+    }
+
+    void frame_export_draw( const char* test )
+    {
+        cpp::shared_frame_writer writer{ segment_name( test ) , 2u , 3u };
+        cpp::shared_frame_reader reader{ segment_name( test ) };
+        cpp::shared_frame_snapshot snapshot;
+
+        std::vector<sf::Vertex> vertices{ sf::Vertex{ sf::Vector2f{ 1.0f , 2.0f } , sf::Color::Red } ,
+                                          sf::Vertex{ sf::Vector2f{ 3.0f , 4.0f } , sf::Color::Green } };
+
+        cpp::frame_export frame{ writer , cpp::aabb_2d<float>::from_coords_and_size( 0.0f , 0.0f , 800.0f , 600.0f ) };
+        frame.draw( vertices.data() , vertices.size() , sf::Points );
+        frame.draw( vertices.data() , vertices.size() , sf::Points );
+
+        check( frame.size() == 3u && frame.dropped() == 1u , test , "the frame doesn't drop what doesn't fit" );
+        check( !reader.read_latest( snapshot ) , test , "read a frame before publish()" );
+
+        frame.publish();
+
+        if( !reader.read_latest( snapshot ) || snapshot.size() != 3u )
+        {
+            check( false , test , "wrong frame size" );
+            return;
+        }
+
+        check( snapshot.x[2] == 1.0f && snapshot.y[2] == 2.0f , test , "wrong positions" );
+        check( snapshot.colors[1].g == 255u && snapshot.colors[1].r == 0u && snapshot.colors[1].a == 255u , test , "wrong colors" );
+    }
+
+    void reader_without_writer( const char* test )
+    {
+        bool thrown = false;
+
+        try
+        {
+            cpp::shared_frame_reader reader{ segment_name( test ) };
+        }
+        catch( const std::runtime_error& )
+        {
+            thrown = true;
+        }
+
+        check( thrown , test , "opened a ring nobody created" );
+    }
+}
+
+int main()
+{
+    std::cout << "%SUITE_STARTING% shared_frame_checks" << std::endl;
+    std::cout << "%SUITE_STARTED%" << std::endl;
+
+    run( "ring_roundtrip" , ring_roundtrip );
+    run( "ring_concurrent_reader" , ring_concurrent_reader );
+    run( "frame_export_draw" , frame_export_draw );
+    run( "reader_without_writer" , reader_without_writer );
+
+    std::cout << "%SUITE_FINISHED% time=0" << std::endl;
+
+    return failed ? 1 : 0;
+}
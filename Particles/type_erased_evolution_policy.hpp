@@ -18,9 +18,122 @@
 
 #include "particle_evolution_policies.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iterator>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
 namespace cpp
 {
-    /* Type-erased particle evolution policy */
+    /* Type-erased column of per-particle states (See cpp::has_particle_state). The states are stored contiguously, 
+     * so the state of the i-th particle is at data() + i * stride() */
+    class erased_state_column
+    {
+    public:
+        //A column for a stateless policy:
+        erased_state_column() = default;
+        
+        template<typename STATE>
+        static erased_state_column make( const STATE& initial_state )
+        {
+            erased_state_column column;
+            column._column.reset( new column_impl<STATE>{ initial_state } );
+            return column;
+        }
+        
+        erased_state_column( const erased_state_column& other ) :
+            _column{ other._column ? other._column->clone() : nullptr }
+        {}
+        
+        erased_state_column( erased_state_column&& ) = default;
+        
+        erased_state_column& operator=( erased_state_column other )
+        {
+            _column = std::move( other._column );
+            return *this;
+        }
+        
+        void resize( std::size_t count )
+        {
+            if( _column ) _column->resize( count );
+        }
+        
+        void permute( const std::vector<std::size_t>& order )
+        {
+            if( _column ) _column->permute( order );
+        }
+        
+        //State of the i-th particle (nullptr if the column belongs to a stateless policy)
+        void* at( std::size_t index )
+        {
+            return _column ? static_cast<char*>( _column->data() ) + index * _column->stride() : nullptr;
+        }
+        
+    private:
+        struct column_interface
+        {
+            virtual ~column_interface(){}
+            
+            virtual void resize( std::size_t count ) = 0;
+            virtual void permute( const std::vector<std::size_t>& order ) = 0;
+            virtual void* data() = 0;
+            virtual std::size_t stride() const = 0;
+            virtual column_interface* clone() const = 0;
+        };
+        
+        template<typename STATE>
+        struct column_impl : public column_interface
+        {
+            column_impl( const STATE& initial ) :
+                initial_state{ initial }
+            {}
+            
+            void resize( std::size_t count ) override
+            {
+                states.resize( count , initial_state );
+            }
+            
+            void permute( const std::vector<std::size_t>& order ) override
+            {
+                cpp::apply_permutation( states , order );
+            }
+            
+            void* data() override
+            {
+                return states.data();
+            }
+            
+            std::size_t stride() const override
+            {
+                return sizeof( STATE );
+            }
+            
+            column_interface* clone() const override
+            {
+                return new column_impl{ *this };
+            }
+            
+            STATE initial_state;
+            std::vector<STATE> states;
+        };
+        
+        std::unique_ptr<column_interface> _column;
+    };
+    
+    
+    /* Type-erased particle evolution policy 
+     *
+     * Policies are stored by value: Small policies (The common case: lambdas, bounds, etc) live in an inline buffer, 
+     * and only the ones which don't fit there go to the heap. Instead of a virtual interface, each policy type has a 
+     * table of function pointers (A handwritten vtable) which is shared by all the instances of that type.
+     * 
+     * So building and copying pipelines does no allocations, and calling a stage doesn't need to follow a pointer
+     * to reach the policy.
+     */
     
     template<typename PARTICLE_DATA>
     class particle_evolution_policy
@@ -28,74 +141,464 @@ namespace cpp
     public:
         using particle_data_policy = PARTICLE_DATA;
         
+        //Policies up to this size are stored inline:
+        static const std::size_t buffer_size = 4 * sizeof( void* );
+        
         template<typename POLICY>
         particle_evolution_policy( const POLICY& policy ) :
-            _policy{ new policy_impl<POLICY>{ policy } }
+            _vtable{ &policy_model<POLICY>::table() }
         {
             TURBO_ASSERT( (cpp::is_policy<POLICY,PARTICLE_DATA>) , "The parameter is not a valid evolution policy class" );
+            
+            policy_model<POLICY>::construct( _storage , policy );
+        }
+        
+        particle_evolution_policy( const particle_evolution_policy& other ) :
+            _vtable{ other._vtable }
+        {
+            if( _vtable ) _vtable->copy( other._storage , _storage );
+        }
+        
+        //Moves never throw (Inline policies must be nothrow movable, see policy_storage), so the pipeline's vector of
+        //stages moves them instead of copying them when it grows:
+        particle_evolution_policy( particle_evolution_policy&& other ) noexcept :
+            _vtable{ other._vtable }
+        {
+            if( _vtable ) _vtable->move( other._storage , _storage );
+            
+            other._vtable = nullptr;
+        }
+        
+        particle_evolution_policy& operator=( const particle_evolution_policy& other )
+        {
+            if( this != &other )
+            {
+                particle_evolution_policy copy{ other };
+                
+                *this = std::move( copy );
+            }
+            
+            return *this;
+        }
+        
+        particle_evolution_policy& operator=( particle_evolution_policy&& other ) noexcept
+        {
+            if( this != &other )
+            {
+                reset();
+                
+                _vtable = other._vtable;
+                
+                if( _vtable ) _vtable->move( other._storage , _storage );
+                
+                other._vtable = nullptr;
+            }
+            
+            return *this;
+        }
+        
+        ~particle_evolution_policy()
+        {
+            reset();
         }
 
         
+        //Only for stateless policies: Stated ones throw std::logic_error (They need the state of the particle, see below)
         void operator()( PARTICLE_DATA& data )
         {
-            (*_policy)( data );
+            _vtable->call( _storage , data , nullptr );
+        }
+        
+        //Stated policies are called with the state of the particle, stored in the column returned by make_state_column():
+        void operator()( PARTICLE_DATA& data , void* state )
+        {
+            _vtable->call( _storage , data , state );
+        }
+        
+        //Executes the policy over a contiguous range of particles, with the states of those particles (If any). 
+        //The loop runs inside the type-erased implementation, so it pays a single indirect call for the whole range:
+        void operator()( PARTICLE_DATA* first , PARTICLE_DATA* last , void* states )
+        {
+            _vtable->apply( _storage , first , last , states );
         }
         
         void step( cpp::evolution_policy_step step )
         {
-            _policy->step( step );
+            _vtable->step( _storage , step );
+        }
+        
+        cpp::erased_state_column make_state_column() const
+        {
+            return _vtable->make_state_column( _storage );
+        }
+        
+        //Identifies the type of the stored policy (All the policies of a type share the same vtable):
+        const void* type_id() const
+        {
+            return _vtable;
         }
     
     private:
+        using storage_type = typename std::aligned_storage<buffer_size>::type;
+        
+        //The handwritten vtable:
+        struct vtable_type
+        {
+            void (*call)( storage_type& storage , PARTICLE_DATA& data , void* state );
+            void (*apply)( storage_type& storage , PARTICLE_DATA* first , PARTICLE_DATA* last , void* states );
+            void (*step)( storage_type& storage , cpp::evolution_policy_step step );
+            cpp::erased_state_column (*make_state_column)( const storage_type& storage );
+            
+            void (*copy)( const storage_type& from , storage_type& to );
+            void (*move)( storage_type& from , storage_type& to ); //Leaves from destroyed
+            void (*destroy)( storage_type& storage );
+        };
         
-        //Interface for policy implementers:
-        struct policy_interface
+        //How the policy is stored (Inline or in the heap):
+        template<typename POLICY , bool INLINE = sizeof( POLICY ) <= sizeof( storage_type ) && 
+                                                 std::alignment_of<POLICY>::value <= std::alignment_of<storage_type>::value &&
+                                                 std::is_nothrow_move_constructible<POLICY>::value>
+        struct policy_storage
         {
-            virtual ~policy_interface(){}
+            static POLICY& get( storage_type& storage )
+            {
+                return *reinterpret_cast<POLICY*>( &storage );
+            }
+            
+            static const POLICY& get( const storage_type& storage )
+            {
+                return *reinterpret_cast<const POLICY*>( &storage );
+            }
+            
+            static void construct( storage_type& storage , const POLICY& policy )
+            {
+                new (&storage) POLICY( policy );
+            }
             
-            virtual void operator()( PARTICLE_DATA& data ) = 0;
+            static void move( storage_type& from , storage_type& to ) noexcept
+            {
+                new (&to) POLICY( std::move( get( from ) ) );
+                destroy( from );
+            }
             
-            virtual void step( cpp::evolution_policy_step step ) = 0;  
+            static void destroy( storage_type& storage )
+            {
+                get( storage ).~POLICY();
+            }
         };
         
-        //Specialized policy implementation
         template<typename POLICY>
-        struct policy_impl : public policy_interface
+        struct policy_storage<POLICY,false>
         {
-            policy_impl( const POLICY& policy ) : 
-                _policy{ policy }
-            {}
-                
-            void operator()( PARTICLE_DATA& data ) override
+            static POLICY& get( storage_type& storage )
+            {
+                return **reinterpret_cast<POLICY**>( &storage );
+            }
+            
+            static const POLICY& get( const storage_type& storage )
+            {
+                return **reinterpret_cast<POLICY* const*>( &storage );
+            }
+            
+            static void construct( storage_type& storage , const POLICY& policy )
+            {
+                new (&storage) POLICY*( new POLICY( policy ) );
+            }
+            
+            static void move( storage_type& from , storage_type& to ) noexcept
+            {
+                new (&to) POLICY*( &get( from ) );
+            }
+            
+            static void destroy( storage_type& storage )
+            {
+                delete &get( storage );
+            }
+        };
+        
+        //How the policy is called (With or without per-particle state):
+        template<typename POLICY , typename HAS_PARTICLE_STATE = cpp::has_particle_state<POLICY>>
+        struct policy_caller
+        {
+            static void call( POLICY& policy , PARTICLE_DATA& data , void* )
+            {
+                cpp::policy_call( policy , data );
+            }
+            
+            //If the policy has a group call, that's its range version (Maybe a batched one, see cpp::vector_field_policy):
+            static void apply( POLICY& policy , PARTICLE_DATA* first , PARTICLE_DATA* last , void* )
+            {
+                apply( policy , first , last , cpp::is_group_policy<POLICY,PARTICLE_DATA*>{} );
+            }
+
+            static void apply( POLICY& policy , PARTICLE_DATA* first , PARTICLE_DATA* last , tml::true_type )
             {
-                cpp::policy_call( _policy , data );
+                cpp::policy_call( policy , first , last );
             }
 
-            void step( cpp::evolution_policy_step step_type ) override
+            static void apply( POLICY& policy , PARTICLE_DATA* first , PARTICLE_DATA* last , tml::false_type )
+            {
+                for( ; first != last ; ++first )
+                    cpp::policy_call( policy , *first );
+            }
+
+            static cpp::erased_state_column make_state_column( const POLICY& )
+            {
+                return cpp::erased_state_column{};
+            }
+        };
+        
+        template<typename POLICY>
+        struct policy_caller<POLICY,tml::true_type>
+        {
+            using state_type = typename cpp::policy_instance_type<POLICY>::particle_state;
+            
+            //A stated stage called without its state would forget it every frame, which is never what the caller wants:
+            static void call( POLICY& policy , PARTICLE_DATA& data , void* state )
+            {
+                if( !state )
+                    throw std::logic_error{ "Stated evolution policy called without its per-particle state" };
+                
+                cpp::policy_instance( policy )( data , *static_cast<state_type*>( state ) );
+            }
+            
+            static void apply( POLICY& policy , PARTICLE_DATA* first , PARTICLE_DATA* last , void* states )
+            {
+                if( !states && first != last )
+                    throw std::logic_error{ "Stated evolution policy called without its per-particle state" };
+                
+                auto& instance = cpp::policy_instance( policy );
+                auto  state    = static_cast<state_type*>( states );
+                
+                for( ; first != last ; ++first , ++state )
+                    instance( *first , *state );
+            }
+            
+            static cpp::erased_state_column make_state_column( const POLICY& policy )
+            {
+                return cpp::erased_state_column::make( cpp::policy_instance( policy ).initial_state() );
+            }
+        };
+        
+        //Specialized policy implementation
+        template<typename POLICY>
+        struct policy_model
+        {
+            using storage = policy_storage<POLICY>;
+            using caller  = policy_caller<POLICY>;
+            
+            static void construct( storage_type& storage_ , const POLICY& policy )
+            {
+                storage::construct( storage_ , policy );
+            }
+            
+            static void call( storage_type& storage_ , PARTICLE_DATA& data , void* state )
             {
-                cpp::policy_step<PARTICLE_DATA>( _policy , step_type );
+                caller::call( storage::get( storage_ ) , data , state );
             }
             
-        private:
-            POLICY _policy;
+            static void apply( storage_type& storage_ , PARTICLE_DATA* first , PARTICLE_DATA* last , void* states )
+            {
+                caller::apply( storage::get( storage_ ) , first , last , states );
+            }
+            
+            static void step( storage_type& storage_ , cpp::evolution_policy_step step_type )
+            {
+                cpp::policy_step<PARTICLE_DATA>( storage::get( storage_ ) , step_type );
+            }
+            
+            static cpp::erased_state_column make_state_column( const storage_type& storage_ )
+            {
+                return caller::make_state_column( storage::get( storage_ ) );
+            }
+            
+            static void copy( const storage_type& from , storage_type& to )
+            {
+                storage::construct( to , storage::get( from ) );
+            }
+            
+            //One vtable per policy type:
+            static const vtable_type& table()
+            {
+                static const vtable_type vtable{ &call , &apply , &step , &make_state_column , &copy , &storage::move , &storage::destroy };
+                
+                return vtable;
+            }
         };
         
-        std::shared_ptr<policy_interface> _policy;
+        void reset() noexcept
+        {
+            if( _vtable ) _vtable->destroy( _storage );
+            
+            _vtable = nullptr;
+        }
+        
+        const vtable_type* _vtable;
+        storage_type       _storage;
     };
     
     
     
+    template<typename PARTICLE_DATA_POLICY>
+    struct evolution_policies_pipeline;
+    
+    //Per-particle state of a pipeline: One column for each stage (Empty columns for stateless stages)
+    template<typename PARTICLE_DATA_POLICY>
+    class evolution_pipeline_state
+    {
+    public:
+        void resize( std::size_t count , const cpp::evolution_policies_pipeline<PARTICLE_DATA_POLICY>& pipeline )
+        {
+            //If the types of the stages have changed, the columns no longer hold the states the stages expect:
+            if( !matches( pipeline ) )
+            {
+                _columns.clear();
+                _stage_types.clear();
+                
+                for( auto& stage : pipeline )
+                {
+                    _columns.push_back( stage.make_state_column() );
+                    _stage_types.push_back( stage.type_id() );
+                }
+            }
+            
+            for( auto& column : _columns )
+                column.resize( count );
+        }
+        
+        void* at( std::size_t stage , std::size_t index )
+        {
+            return _columns[stage].at( _offset + index );
+        }
+        
+        //See particle_state_column_t::offset()
+        void offset( std::size_t first )
+        {
+            _offset = first;
+        }
+        
+        void permute( const std::vector<std::size_t>& order )
+        {
+            for( auto& column : _columns )
+                column.permute( order );
+        }
+
+        
+    private:
+        bool matches( const cpp::evolution_policies_pipeline<PARTICLE_DATA_POLICY>& pipeline ) const
+        {
+            std::size_t stage = 0;
+            
+            for( auto& policy : pipeline )
+                if( stage >= _stage_types.size() || _stage_types[stage++] != policy.type_id() )
+                    return false;
+            
+            return stage == _stage_types.size();
+        }
+        
+        std::vector<cpp::erased_state_column> _columns;
+        std::vector<const void*> _stage_types; //Type of the stage of each column (See particle_evolution_policy::type_id())
+        std::size_t _offset = 0;
+    };
+    
+    /* Un pipeline puede ejecutarse de dos maneras:
+     *
+     *  - Por partículas (particle_major): Para cada partícula, se ejecutan todas las etapas. Los datos de la partícula 
+     *    están en caché durante todo el pipeline.
+     *  - Por etapas (stage_major): Se ejecuta la etapa 1 sobre un bloque de partículas, después la etapa 2 sobre el mismo
+     *    bloque, etc. El código de cada etapa está en caché durante todo el bloque, y el bucle sobre las partículas está
+     *    dentro de la etapa (Un solo salto virtual por bloque, y el compilador puede vectorizarlo).
+     *
+     * Cuál es más rápida depende de las etapas y de la máquina, así que el modo automatic mide las dos durante los
+     * primeros frames y se queda con la más rápida.
+     */
+    enum class pipeline_execution_order
+    {
+        particle_major ,
+        stage_major ,
+        automatic
+    };
+    
+    /* Muchas etapas sólo afectan a una parte de las partículas (Las que están cerca de un obstáculo, las que están muertas, 
+     * etc). En vez de llamar a la etapa para todas y que ella decida qué hacer, una etapa puede tener un predicado: 
+     * El pipeline evalúa el predicado sobre cada bloque y guarda los índices de las partículas seleccionadas (Un vector de
+     * selección, como hacen las bases de datos por columnas), y la etapa sólo se ejecuta sobre esos índices.
+     *
+     * El predicado se evalúa justo antes de la etapa, es decir, sobre el resultado de las etapas anteriores.
+     */
+    template<typename PARTICLE_DATA_POLICY>
+    using stage_predicate = std::function<bool(const PARTICLE_DATA_POLICY&)>;
+    
+    /* Hay etapas (Sobre todo las cosméticas, como cambiar el color según la posición) que no necesitan ejecutarse en 
+     * todos los frames sobre todas las partículas. Su coste puede repartirse entre varios frames:
+     *
+     *  - every_n_frames(N): La etapa se ejecuta sobre todas las partículas, pero sólo uno de cada N frames.
+     *  - round_robin(N): La etapa se ejecuta todos los frames, pero sólo sobre 1/N de las partículas (Un bloque contiguo
+     *    distinto cada frame, así que en N frames ha pasado por todas).
+     *
+     * El pipeline lleva la cuenta de los frames, y reparte las fases de las etapas escalonadas para que no coincidan 
+     * todas en el mismo frame.
+     */
+    class stage_update_rate
+    {
+    public:
+        static stage_update_rate every_frame()
+        {
+            return stage_update_rate{ 1u , false };
+        }
+        
+        static stage_update_rate every_n_frames( std::size_t n )
+        {
+            return stage_update_rate{ n , false };
+        }
+        
+        static stage_update_rate round_robin( std::size_t n )
+        {
+            return stage_update_rate{ n , true };
+        }
+        
+        std::size_t period() const
+        {
+            return _period;
+        }
+        
+        bool is_round_robin() const
+        {
+            return _round_robin;
+        }
+        
+        bool is_staggered() const
+        {
+            return _period > 1u;
+        }
+        
+    private:
+        stage_update_rate( std::size_t period , bool round_robin ) :
+            _period{ period > 0u ? period : 1u } ,
+            _round_robin{ round_robin }
+        {}
+        
+        std::size_t _period;
+        bool _round_robin;
+    };
     
     template<typename PARTICLE_DATA_POLICY>
     struct evolution_policies_pipeline
     {
     public:
         using stage_type = cpp::particle_evolution_policy<PARTICLE_DATA_POLICY>;
+        using predicate_type = cpp::stage_predicate<PARTICLE_DATA_POLICY>;
         using iterator = typename std::vector<cpp::particle_evolution_policy<PARTICLE_DATA_POLICY>>::iterator;
+        using const_iterator = typename std::vector<cpp::particle_evolution_policy<PARTICLE_DATA_POLICY>>::const_iterator;
+        
+        using particle_state_column = cpp::evolution_pipeline_state<PARTICLE_DATA_POLICY>;
         
         evolution_policies_pipeline() = default;
         
-        void operator()( PARTICLE_DATA_POLICY& data )
+        static_assert( std::is_nothrow_move_constructible<stage_type>::value , "Growing the pipeline would copy its stages" );
+        
+        template<typename ITERATOR>
+        void operator()( ITERATOR first , ITERATOR last , particle_state_column& states )
         {
             /* Nótese que data es una referencia a los datos de la partícula 
              *
@@ -117,23 +620,65 @@ namespace cpp
              * de la etapa n, y así sucesivamente. Al ser los datos de la partícula
              * pasados como una referencia, ése comportamiento es muy fácil de simular 
              * (Un simple bucle a través del pipeline)
+             * 
+             * Cada etapa recibe además el estado que guarda para esa partícula (Si lo tiene)
              */
-            for( auto& policy : _pipeline )
-                policy( data );
+            PARTICLE_DATA_POLICY* begin = &*first;
+            PARTICLE_DATA_POLICY* end   = begin + std::distance( first , last );
+            
+            if( _execution_order != cpp::pipeline_execution_order::automatic )
+                execute( _execution_order , begin , end , states );
+            else
+                calibrate( begin , end , states );
+        }
+        
+        void execution_order( cpp::pipeline_execution_order order )
+        {
+            _execution_order = order;
+            _calibration     = calibration_data{};
+        }
+        
+        cpp::pipeline_execution_order execution_order() const
+        {
+            return _execution_order;
+        }
+        
+        //Número de partículas por bloque en la ejecución por etapas (Al menos una):
+        void chunk_size( std::size_t size )
+        {
+            _chunk_size = size > 0u ? size : 1u;
+        }
+        
+        std::size_t chunk_size() const
+        {
+            return _chunk_size;
         }
         
         void step( cpp::evolution_policy_step step_type )
         {
             for( auto& policy : _pipeline )
                 policy.step( step_type );
+            
+            if( step_type == cpp::evolution_policy_step::global )
+                _frame++;
+        }
+        
+        iterator begin()
+        {
+            return std::begin( _pipeline );
+        }
+        
+        iterator end()
+        {
+            return std::end( _pipeline );
         }
         
-        iterator begin() const
+        const_iterator begin() const
         {
             return std::begin( _pipeline );
         }
         
-        iterator end() const
+        const_iterator end() const
         {
             return std::end( _pipeline );
         }
@@ -159,24 +704,181 @@ namespace cpp
         }
         
         template<typename POLICY>
-        void add_stage( POLICY&& policy )
+        void add_stage( POLICY&& policy , const predicate_type& predicate = predicate_type{} , 
+                        cpp::stage_update_rate rate = cpp::stage_update_rate::every_frame() )
+        {
+            insert_stage( _pipeline.size() , std::forward<POLICY>( policy ) , predicate , rate );
+        }
+        
+        template<typename POLICY>
+        void add_stage( POLICY&& policy , cpp::stage_update_rate rate )
         {
-            _pipeline.push_back( std::forward<POLICY>( policy ) );
+            add_stage( std::forward<POLICY>( policy ) , predicate_type{} , rate );
         }
         
         template<typename POLICY>
-        void insert_stage( std::size_t stage , POLICY&& policy )
+        void insert_stage( std::size_t stage , POLICY&& policy , const predicate_type& predicate = predicate_type{} , 
+                           cpp::stage_update_rate rate = cpp::stage_update_rate::every_frame() )
         {
             _pipeline.insert( _pipeline.begin() + stage , std::forward<POLICY>( policy ) );
+            _predicates.insert( _predicates.begin() + stage , predicate );
+            _schedules.insert( _schedules.begin() + stage , stage_schedule{ rate , rate.is_staggered() ? _staggered_stages++ : 0u } );
         }
         
         void remove_stage( std::size_t stage )
         {
             _pipeline.erase( _pipeline.begin() + stage );
+            _predicates.erase( _predicates.begin() + stage );
+            _schedules.erase( _schedules.begin() + stage );
+        }
+        
+        //Cambia el predicado de una etapa (Un predicado vacío significa que la etapa se ejecuta sobre todas las partículas):
+        void stage_predicate( std::size_t stage , const predicate_type& predicate )
+        {
+            _predicates[stage] = predicate;
+        }
+        
+        const predicate_type& stage_predicate( std::size_t stage ) const
+        {
+            return _predicates[stage];
         }
         
     private:
+        //Frames medidos con cada orden de ejecución antes de decidir:
+        static const std::size_t calibration_frames = 32;
+        
+        struct calibration_data
+        {
+            std::size_t frames = 0;
+            double particle_major_time = 0.0 , stage_major_time = 0.0;
+            cpp::pipeline_execution_order selected = cpp::pipeline_execution_order::automatic;
+        };
+        
+        struct stage_schedule
+        {
+            cpp::stage_update_rate rate;
+            std::size_t phase;
+            
+            //Rango de partículas sobre el que se ejecuta la etapa en este frame (Vacío si no le toca):
+            std::pair<std::size_t,std::size_t> active_range( std::size_t frame , std::size_t count ) const
+            {
+                std::size_t slot = ( frame + phase ) % rate.period();
+                
+                if( rate.is_round_robin() )
+                    return std::make_pair( count * slot / rate.period() , count * ( slot + 1 ) / rate.period() );
+                else
+                    return slot == 0 ? std::make_pair( std::size_t{ 0 } , count ) : std::make_pair( std::size_t{ 0 } , std::size_t{ 0 } );
+            }
+        };
+        
+        void execute( cpp::pipeline_execution_order order , PARTICLE_DATA_POLICY* first , PARTICLE_DATA_POLICY* last , particle_state_column& states )
+        {
+            std::size_t count = last - first;
+            
+            _active_ranges.resize( _pipeline.size() );
+            
+            for( std::size_t stage = 0 ; stage < _pipeline.size() ; ++stage )
+                _active_ranges[stage] = _schedules[stage].active_range( _frame , count );
+            
+            if( order == cpp::pipeline_execution_order::particle_major )
+            {
+                //Aquí el predicado se comprueba directamente, partícula a partícula:
+                for( std::size_t i = 0 ; i < count ; ++i )
+                    for( std::size_t stage = 0 ; stage < _pipeline.size() ; ++stage )
+                        if( i >= _active_ranges[stage].first && i < _active_ranges[stage].second &&
+                            ( !_predicates[stage] || _predicates[stage]( first[i] ) ) )
+                            _pipeline[stage]( first[i] , states.at( stage , i ) );
+            }
+            else
+            {
+                for( std::size_t chunk_begin = 0 ; chunk_begin < count ; chunk_begin += _chunk_size )
+                {
+                    std::size_t chunk_end = std::min( chunk_begin + _chunk_size , count );
+                    
+                    for( std::size_t stage = 0 ; stage < _pipeline.size() ; ++stage )
+                    {
+                        std::size_t begin = std::max( chunk_begin , _active_ranges[stage].first ) ,
+                                    end   = std::min( chunk_end , _active_ranges[stage].second );
+                        
+                        if( begin >= end )
+                            continue;
+                        
+                        if( _predicates[stage] )
+                            execute_masked( stage , first , begin , end , states );
+                        else
+                            _pipeline[stage]( first + begin , first + end , states.at( stage , begin ) );
+                    }
+                }
+            }
+        }
+        
+        void execute_masked( std::size_t stage , PARTICLE_DATA_POLICY* first , std::size_t chunk_begin , std::size_t chunk_end , particle_state_column& states )
+        {
+            const predicate_type& predicate = _predicates[stage];
+            
+            //Primero el vector de selección (Sin saltos: Siempre se escribe el índice, pero sólo se avanza si está seleccionado)...
+            _selection.resize( chunk_end - chunk_begin + 1 );
+            
+            std::size_t selected = 0;
+            
+            for( std::size_t i = chunk_begin ; i < chunk_end ; ++i )
+            {
+                _selection[selected] = i;
+                selected += predicate( first[i] ) ? 1u : 0u;
+            }
+            
+            //... y después la etapa sobre las partículas seleccionadas. Los índices consecutivos se agrupan en rangos, así
+            //la etapa sigue recibiendo rangos contiguos (Junto con su estado) en vez de partículas sueltas:
+            for( std::size_t run_begin = 0 ; run_begin < selected ; )
+            {
+                std::size_t run_end = run_begin + 1;
+                
+                while( run_end < selected && _selection[run_end] == _selection[run_end - 1] + 1 )
+                    ++run_end;
+                
+                std::size_t begin = _selection[run_begin] , end = _selection[run_end - 1] + 1;
+                
+                _pipeline[stage]( first + begin , first + end , states.at( stage , begin ) );
+                
+                run_begin = run_end;
+            }
+        }
+        
+        void calibrate( PARTICLE_DATA_POLICY* first , PARTICLE_DATA_POLICY* last , particle_state_column& states )
+        {
+            if( _calibration.selected != cpp::pipeline_execution_order::automatic )
+            {
+                execute( _calibration.selected , first , last , states );
+                return;
+            }
+            
+            //Alternamos los dos órdenes, para que ambos vean las mismas condiciones (Caché, frecuencia de la CPU, etc):
+            bool particle_major = _calibration.frames % 2 == 0;
+            
+            auto start = std::chrono::high_resolution_clock::now();
+            
+            execute( particle_major ? cpp::pipeline_execution_order::particle_major : cpp::pipeline_execution_order::stage_major , first , last , states );
+            
+            double elapsed = std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - start ).count();
+            
+            ( particle_major ? _calibration.particle_major_time : _calibration.stage_major_time ) += elapsed;
+            
+            if( ++_calibration.frames == 2 * calibration_frames )
+                _calibration.selected = _calibration.particle_major_time <= _calibration.stage_major_time ? cpp::pipeline_execution_order::particle_major :
+                                                                                                            cpp::pipeline_execution_order::stage_major;
+        }
+        
         std::vector<cpp::particle_evolution_policy<PARTICLE_DATA_POLICY>> _pipeline;
+        std::vector<predicate_type> _predicates; //Uno por etapa
+        std::vector<stage_schedule> _schedules;  //Uno por etapa
+        std::vector<std::size_t> _selection;
+        std::vector<std::pair<std::size_t,std::size_t>> _active_ranges;
+        std::size_t _frame = 0;
+        std::size_t _staggered_stages = 0;
+        
+        cpp::pipeline_execution_order _execution_order = cpp::pipeline_execution_order::particle_major;
+        std::size_t _chunk_size = 1024u;
+        calibration_data _calibration;
     };
 }
 
@@ -20,6 +20,8 @@
 
 #include <vector>
 #include <bitset>
+#include <limits>
+#include <utility>
 
 namespace cpp {
     
@@ -195,6 +197,48 @@ namespace cpp {
 
         }
 
+        //True if the box is completely inside this one:
+        bool contains(const aabb_2d& box) const
+        {
+            return box.left() >= left() && box.right() <= right() &&
+                   box.bottom() >= bottom() && box.top() <= top();
+        }
+
+        //Slab test: The line from + direction * t is inside the box for t in [enter,exit]. enter_axis and exit_axis are the
+        //axes (0 = x, 1 = y) of the sides where the line enters and leaves the box (-1 if it's always inside along that axis).
+        //Returns false if the line misses the box.
+        bool slab_interval(const dl32::vector_2d<T>& from, const dl32::vector_2d<T>& direction,
+                           T& enter, T& exit, int& enter_axis, int& exit_axis) const
+        {
+            enter = -std::numeric_limits<T>::infinity();
+            exit  =  std::numeric_limits<T>::infinity();
+            enter_axis = exit_axis = -1;
+
+            const T min[2] = { left(), bottom() };
+            const T max[2] = { right(), top() };
+
+            for (int axis = 0; axis < 2; ++axis)
+            {
+                if (direction[axis] == T{})
+                {
+                    if (from[axis] < min[axis] || from[axis] > max[axis])
+                        return false;
+
+                    continue;
+                }
+
+                T t0 = (min[axis] - from[axis]) / direction[axis];
+                T t1 = (max[axis] - from[axis]) / direction[axis];
+
+                if (t0 > t1) std::swap(t0, t1);
+
+                if (t0 > enter) { enter = t0; enter_axis = axis; }
+                if (t1 < exit)  { exit  = t1; exit_axis  = axis; }
+            }
+
+            return enter <= exit;
+        }
+
         bool belongs_to(const dl32::vector_2d<T>& point) const {
             return cpp::wrap( point.x ) >= cpp::wrap( left() ) &&
                    cpp::wrap( point.x ) <= cpp::wrap( right() ) &&
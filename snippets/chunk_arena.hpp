@@ -0,0 +1,387 @@
+/****************************************************************************
+* Snippets, ejemplos, y utilidades del curso de C++ orientado a videojuegos *
+* https://github.com/Manu343726/CppVideojuegos/                             *
+*                                                                           *
+* Copyright © 2014 Manuel Sánchez Pérez                                     *
+*                                                                           *
+* This program is free software. It comes without any warranty, to          *
+* the extent permitted by applicable law. You can redistribute it           *
+* and/or modify it under the terms of the Do What The Fuck You Want         *
+* To Public License, Version 2, as published by Sam Hocevar. See            *
+* http://www.wtfpl.net/  and the COPYING file for more details.             *
+****************************************************************************/
+
+#ifndef CHUNK_ARENA_HPP
+#define	CHUNK_ARENA_HPP
+
+/* Chunked arena for big arrays which never relocate
+ *
+ * A std::vector grows by allocating a bigger buffer and copying everything there. With arrays of hundreds of
+ * thousands of elements that's a lot of copying, and the old buffers fragment the heap.
+ *
+ * cpp::chunk_arena reserves a huge range of virtual address space once (Address space only: No memory is used
+ * until it's committed), and splits it in regions. Each cpp::arena_vector owns one region, and commits memory
+ * at the end of it in fixed-size chunks (16 KiB by default) as it grows. So:
+ *
+ *  - The elements are contiguous, and growing never moves them (Pointers and iterators stay valid).
+ *  - Chunks are page and cache line aligned, so they can be used directly as parallel work items (See chunk_size()).
+ *  - Regions are aligned to 2 MiB and the arena asks for transparent huge pages (Where the OS supports it).
+ *
+ * The price is a maximum capacity per vector (The size of a region, 1 GiB by default). The number of vectors is not
+ * limited: When all the regions are taken, the arena reserves another block of regions.
+ */
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <iterator>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#if defined( _WIN32 )
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace cpp
+{
+    class chunk_arena
+    {
+    public:
+        static const std::size_t huge_page_size = 2u * 1024u * 1024u;
+
+        //region_count is the number of regions reserved at once (The first block, and each one added when they run out):
+        chunk_arena( std::size_t region_bytes , std::size_t region_count ) :
+            _region_bytes{ round_up( region_bytes , huge_page_size ) } ,
+            _region_count{ std::max<std::size_t>( region_count , 1u ) }
+        {
+            add_block();
+        }
+
+        chunk_arena( const chunk_arena& ) = delete;
+        chunk_arena& operator=( const chunk_arena& ) = delete;
+
+        ~chunk_arena()
+        {
+            for( auto& block : _blocks )
+                release( block.reserved , block.bytes );
+        }
+
+        std::size_t region_bytes() const
+        {
+            return _region_bytes;
+        }
+
+        //A region of region_bytes() bytes of address space, with no memory committed yet:
+        char* acquire_region()
+        {
+            std::lock_guard<std::mutex> lock{ _mutex };
+
+            if( _free_regions.empty() )
+                add_block();
+
+            char* region = _free_regions.back();
+            _free_regions.pop_back();
+
+            return region;
+        }
+
+        //Returns the region to the arena (Its committed memory goes back to the OS):
+        void release_region( char* region , std::size_t committed_bytes )
+        {
+            decommit( region , committed_bytes );
+
+            std::lock_guard<std::mutex> lock{ _mutex };
+            _free_regions.push_back( region );
+        }
+
+        static bool commit( char* address , std::size_t bytes )
+        {
+#if defined( _WIN32 )
+            return VirtualAlloc( address , bytes , MEM_COMMIT , PAGE_READWRITE ) != nullptr;
+#else
+            return mprotect( address , bytes , PROT_READ | PROT_WRITE ) == 0;
+#endif
+        }
+
+        static void decommit( char* address , std::size_t bytes )
+        {
+            if( bytes == 0 ) return;
+
+#if defined( _WIN32 )
+            VirtualFree( address , bytes , MEM_DECOMMIT );
+#else
+            madvise( address , bytes , MADV_DONTNEED );
+            mprotect( address , bytes , PROT_NONE );
+#endif
+        }
+
+        //Blocks of 64 regions of 1 GiB on 64 bit systems, 8 regions of 64 MiB on 32 bit ones:
+        static chunk_arena& global()
+        {
+            static chunk_arena arena{ sizeof( void* ) >= 8 ? ( std::size_t{ 1 } << 30 ) : ( std::size_t{ 1 } << 26 ) ,
+                                      sizeof( void* ) >= 8 ? 64u : 8u };
+
+            return arena;
+        }
+
+    private:
+        struct block
+        {
+            char* reserved;
+            std::size_t bytes;
+        };
+
+        //Reserves region_count more regions (Throws std::bad_alloc if there's no address space left):
+        void add_block()
+        {
+            //One extra huge page to align the first region:
+            std::size_t bytes = _region_bytes * _region_count + huge_page_size;
+            char* reserved = reserve( bytes );
+
+            if( !reserved )
+                throw std::bad_alloc{};
+
+            _blocks.push_back( block{ reserved , bytes } );
+
+            char* base = reinterpret_cast<char*>( round_up( reinterpret_cast<std::uintptr_t>( reserved ) , huge_page_size ) );
+
+            for( std::size_t i = _region_count ; i > 0 ; --i )
+                _free_regions.push_back( base + ( i - 1 ) * _region_bytes );
+        }
+
+        static std::uintptr_t round_up( std::uintptr_t value , std::uintptr_t alignment )
+        {
+            return ( value + alignment - 1 ) / alignment * alignment;
+        }
+
+        static char* reserve( std::size_t bytes )
+        {
+#if defined( _WIN32 )
+            return static_cast<char*>( VirtualAlloc( nullptr , bytes , MEM_RESERVE , PAGE_NOACCESS ) );
+#else
+            void* address = mmap( nullptr , bytes , PROT_NONE , MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE , -1 , 0 );
+
+            if( address == MAP_FAILED )
+                return nullptr;
+
+#if defined( MADV_HUGEPAGE )
+            madvise( address , bytes , MADV_HUGEPAGE );
+#endif
+            return static_cast<char*>( address );
+#endif
+        }
+
+        static void release( char* address , std::size_t bytes )
+        {
+#if defined( _WIN32 )
+            (void)bytes;
+            VirtualFree( address , 0 , MEM_RELEASE );
+#else
+            munmap( address , bytes );
+#endif
+        }
+
+        std::size_t _region_bytes , _region_count;
+        std::vector<block> _blocks;
+
+        std::mutex _mutex;
+        std::vector<char*> _free_regions;
+    };
+
+    /* A contiguous, growable array which lives in a region of a chunk_arena. Supports the subset of the std::vector
+     * interface the particle engine needs. The iterators are plain pointers.
+     */
+    template<typename T , std::size_t CHUNK_BYTES = 16384u>
+    class arena_vector
+    {
+    public:
+        static_assert( CHUNK_BYTES % 64u == 0 , "Chunks should be cache line aligned" );
+        static_assert( sizeof( T ) <= CHUNK_BYTES , "An element doesn't fit in a chunk" );
+
+        using value_type     = T;
+        using iterator       = T*;
+        using const_iterator = const T*;
+
+        arena_vector( cpp::chunk_arena& arena = cpp::chunk_arena::global() ) :
+            _arena{ &arena }
+        {}
+
+        arena_vector( const arena_vector& other ) :
+            _arena{ other._arena }
+        {
+            reserve( other.size() );
+
+            for( auto& value : other )
+                push_back( value );
+        }
+
+        //Moves never throw, so containers of arena_vectors (Or of particle groups) move them instead of copying them:
+        arena_vector( arena_vector&& other ) noexcept :
+            _arena{ other._arena } ,
+            _region{ other._region } ,
+            _size{ other._size } ,
+            _committed{ other._committed }
+        {
+            other._region = nullptr;
+            other._size = other._committed = 0;
+        }
+
+        arena_vector& operator=( arena_vector other ) noexcept
+        {
+            swap( other );
+            return *this;
+        }
+
+        ~arena_vector()
+        {
+            clear();
+
+            if( _region )
+                _arena->release_region( _region , _committed );
+        }
+
+        void swap( arena_vector& other ) noexcept
+        {
+            std::swap( _arena , other._arena );
+            std::swap( _region , other._region );
+            std::swap( _size , other._size );
+            std::swap( _committed , other._committed );
+        }
+
+        //Number of elements which fit in a chunk. Splitting the work in blocks of chunk_size() elements gives blocks of
+        //(Almost exactly) one chunk each:
+        static constexpr std::size_t chunk_size()
+        {
+            return CHUNK_BYTES / sizeof( T );
+        }
+
+        //Commits the chunks needed for count elements (The elements don't move anyway, so this is just a hint):
+        void reserve( std::size_t count )
+        {
+            std::size_t bytes = ( count * sizeof( T ) + CHUNK_BYTES - 1 ) / CHUNK_BYTES * CHUNK_BYTES;
+
+            if( bytes <= _committed )
+                return;
+
+            if( !_region )
+                _region = _arena->acquire_region();
+
+            if( bytes > _arena->region_bytes() )
+                throw std::length_error{ "arena_vector: The region is full" };
+
+            if( !cpp::chunk_arena::commit( _region + _committed , bytes - _committed ) )
+                throw std::bad_alloc{};
+
+            _committed = bytes;
+        }
+
+        void push_back( const T& value )
+        {
+            emplace_back( value );
+        }
+
+        void push_back( T&& value )
+        {
+            emplace_back( std::move( value ) );
+        }
+
+        template<typename... ARGS>
+        void emplace_back( ARGS&&... args )
+        {
+            reserve( _size + 1 );
+
+            new ( data() + _size ) T{ std::forward<ARGS>( args )... };
+            _size++;
+        }
+
+        void resize( std::size_t count , const T& value = T{} )
+        {
+            reserve( count );
+
+            while( _size < count )
+                new ( data() + _size++ ) T{ value };
+
+            while( _size > count )
+                data()[--_size].~T();
+        }
+
+        void clear()
+        {
+            resize( 0 );
+        }
+
+        T* data()
+        {
+            return reinterpret_cast<T*>( _region );
+        }
+
+        const T* data() const
+        {
+            return reinterpret_cast<const T*>( _region );
+        }
+
+        std::size_t size() const
+        {
+            return _size;
+        }
+
+        bool empty() const
+        {
+            return _size == 0;
+        }
+
+        T& operator[]( std::size_t index )
+        {
+            return data()[index];
+        }
+
+        const T& operator[]( std::size_t index ) const
+        {
+            return data()[index];
+        }
+
+        T& front()
+        {
+            return data()[0];
+        }
+
+        T& back()
+        {
+            return data()[_size - 1];
+        }
+
+        iterator begin()
+        {
+            return data();
+        }
+
+        iterator end()
+        {
+            return data() + _size;
+        }
+
+        const_iterator begin() const
+        {
+            return data();
+        }
+
+        const_iterator end() const
+        {
+            return data() + _size;
+        }
+
+    private:
+        cpp::chunk_arena* _arena;
+        char* _region = nullptr;
+        std::size_t _size = 0 , _committed = 0;
+    };
+}
+
+#endif	/* CHUNK_ARENA_HPP */
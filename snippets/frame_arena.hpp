@@ -0,0 +1,293 @@
+/****************************************************************************
+* Snippets, ejemplos, y utilidades del curso de C++ orientado a videojuegos *
+* https://github.com/Manu343726/CppVideojuegos/                             *
+*                                                                           *
+* Copyright © 2014 Manuel Sánchez Pérez                                     *
+*                                                                           *
+* This program is free software. It comes without any warranty, to          *
+* the extent permitted by applicable law. You can redistribute it           *
+* and/or modify it under the terms of the Do What The Fuck You Want         *
+* To Public License, Version 2, as published by Sam Hocevar. See            *
+* http://www.wtfpl.net/  and the COPYING file for more details.             *
+****************************************************************************/
+
+#ifndef FRAME_ARENA_HPP
+#define	FRAME_ARENA_HPP
+
+/* Per-frame scratch memory
+ *
+ * A simulation step is full of temporary buffers (Sort keys, accelerations, vertices of a chunk...) which live for
+ * a few microseconds. Getting them from the heap every frame means a malloc/free pair per buffer, per frame, per
+ * thread, and the heap locks and fragments under that pattern.
+ *
+ * cpp::frame_arena is a bump allocator: Allocating is moving a pointer forward, and freeing everything at once is
+ * moving it back to the beginning. Each thread has its own arena (See local()), so allocating never synchronizes.
+ * The memory is valid until the end of the frame (See next_frame()): Each arena rewinds itself the first time it's
+ * used in a new frame. It also rewinds as soon as all its allocations have been released, so code which never calls
+ * next_frame() doesn't grow it forever. Each rewind starts a new generation, and each allocation remembers the arena
+ * and the generation it comes from: Releasing a buffer of an earlier generation does nothing (Its memory was already
+ * reclaimed), and a buffer released in another thread is given back to its own arena.
+ *
+ * If a frame needs more than the arena has, the rest comes from extra heap blocks, and at the next rewind the arena
+ * grows to the peak of that frame. In the steady state a frame never touches the heap. A rewind with buffers still
+ * alive is a bug (Asserted on debug builds): Those buffers keep their memory, and the arena neither rewinds nor grows
+ * until they are released.
+ *
+ * cpp::frame_allocator plugs the arena into the standard containers (cpp::frame_vector<T>, etc). Scratch containers
+ * must not outlive the frame: Don't store them in members.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace cpp
+{
+    class frame_arena
+    {
+    public:
+        static const std::size_t default_capacity = 64u * 1024u;
+
+        frame_arena( std::size_t capacity = default_capacity ) :
+            _memory{ new char[capacity] } ,
+            _capacity{ capacity }
+        {}
+
+        frame_arena( const frame_arena& ) = delete;
+        frame_arena& operator=( const frame_arena& ) = delete;
+
+        //alignment must be a power of two:
+        void* allocate( std::size_t bytes , std::size_t alignment = alignof( std::max_align_t ) )
+        {
+            std::uint64_t frame = frame_counter().load( std::memory_order_relaxed );
+
+            if( frame != _frame )
+            {
+                reset();
+                _frame = frame;
+            }
+
+            _peak += bytes + alignment + sizeof( header );
+            _live.fetch_add( 1u , std::memory_order_relaxed );
+
+            std::uintptr_t base  = reinterpret_cast<std::uintptr_t>( _memory.get() );
+            std::uintptr_t first = align( base + _used + sizeof( header ) , alignment );
+
+            if( first + bytes <= base + _capacity )
+            {
+                write_header( first , _used );
+                _used = first + bytes - base;
+                return reinterpret_cast<void*>( first );
+            }
+
+            //Doesn't fit: Extra block until the next rewind
+            _overflow.emplace_back( new char[bytes + alignment + sizeof( header )] );
+
+            first = align( reinterpret_cast<std::uintptr_t>( _overflow.back().get() ) + sizeof( header ) , alignment );
+            write_header( first , _used );
+
+            return reinterpret_cast<void*>( first );
+        }
+
+        //Releasing the last allocation gives its memory back at once (Scoped buffers are released in LIFO order). A buffer
+        //allocated by another arena (In another thread) is released in its arena, and a buffer of an earlier generation
+        //doesn't count against the current one.
+        void deallocate( void* pointer , std::size_t bytes )
+        {
+            header h = header_of( pointer );
+
+            if( h.owner != this )
+            {
+                h.owner->release( h.generation );
+                return;
+            }
+
+            char* first = static_cast<char*>( pointer );
+
+            if( h.generation == _generation.load( std::memory_order_relaxed ) &&
+                first >= _memory.get() && first + bytes == _memory.get() + _used )
+                _used = h.previous;
+
+            if( release( h.generation ) )
+                reset();
+        }
+
+        //Starts a new generation and frees everything. O(1), unless the last frame didn't fit
+        void reset()
+        {
+            assert( live() == 0 && _stale.load() == 0 && "A frame arena was rewound with scratch buffers still alive" );
+
+            //The buffers still alive belong to an earlier generation from now on. They keep their memory (And their headers)
+            //until they are released, so the arena only rewinds (And grows) when there are none:
+            _stale.fetch_add( _live.exchange( 0u , std::memory_order_acq_rel ) , std::memory_order_acq_rel );
+            _generation.fetch_add( 1u , std::memory_order_release );
+
+            if( _stale.load( std::memory_order_acquire ) > 0 )
+                return;
+
+            if( !_overflow.empty() )
+            {
+                _overflow.clear();
+
+                _capacity = std::max( _capacity * 2u , _peak );
+                _memory.reset( new char[_capacity] );
+            }
+
+            _used = 0;
+            _peak = 0;
+        }
+
+        std::size_t capacity() const
+        {
+            return _capacity;
+        }
+
+        std::size_t used() const
+        {
+            return _used;
+        }
+
+        //Allocations of the current generation not released yet:
+        std::size_t live() const
+        {
+            return _live.load( std::memory_order_acquire );
+        }
+
+        //The arena of the calling thread:
+        static frame_arena& local()
+        {
+            static thread_local frame_arena arena;
+
+            return arena;
+        }
+
+        //Ends the frame: All the scratch memory of every thread is free again. Called once per frame, after the last use
+        //of the scratch buffers of that frame (Each arena rewinds lazily, on its next allocation):
+        static void next_frame()
+        {
+            frame_counter().fetch_add( 1u , std::memory_order_relaxed );
+        }
+
+    private:
+        //Stored right before each allocation:
+        struct header
+        {
+            frame_arena* owner;
+            std::uint64_t generation;
+            std::size_t previous; //Used bytes before the allocation
+        };
+
+        static std::uintptr_t align( std::uintptr_t address , std::size_t alignment )
+        {
+            return ( address + alignment - 1u ) & ~static_cast<std::uintptr_t>( alignment - 1u );
+        }
+
+        void write_header( std::uintptr_t first , std::size_t previous )
+        {
+            header h{ this , _generation.load( std::memory_order_relaxed ) , previous };
+
+            std::memcpy( reinterpret_cast<char*>( first ) - sizeof( header ) , &h , sizeof( header ) );
+        }
+
+        static header header_of( void* pointer )
+        {
+            header h;
+
+            std::memcpy( &h , static_cast<char*>( pointer ) - sizeof( header ) , sizeof( header ) );
+            return h;
+        }
+
+        //Releases an allocation of the given generation (Maybe from another thread). Returns true if that was the last live
+        //allocation of the current generation:
+        bool release( std::uint64_t generation )
+        {
+            bool current = generation == _generation.load( std::memory_order_acquire );
+
+            return decrement( current ? _live : _stale ) && current;
+        }
+
+        //Never goes below zero. Returns true if the count reaches zero:
+        static bool decrement( std::atomic<std::size_t>& count )
+        {
+            std::size_t value = count.load( std::memory_order_relaxed );
+
+            do
+            {
+                if( value == 0 )
+                    return false;
+            }
+            while( !count.compare_exchange_weak( value , value - 1u , std::memory_order_acq_rel , std::memory_order_relaxed ) );
+
+            return value == 1u;
+        }
+
+        static std::atomic<std::uint64_t>& frame_counter()
+        {
+            static std::atomic<std::uint64_t> counter{ 0u };
+
+            return counter;
+        }
+
+        std::unique_ptr<char[]> _memory;
+        std::size_t _capacity;
+        std::size_t _used = 0;
+        std::atomic<std::size_t> _live{ 0u };          //Allocations not released yet (Other threads release them too)
+        std::atomic<std::size_t> _stale{ 0u };         //Allocations of earlier generations not released yet
+        std::atomic<std::uint64_t> _generation{ 0u };  //Rewinds so far
+        std::size_t _peak = 0; //Bytes requested since the last rewind of the memory (Including alignment and headers)
+        std::uint64_t _frame = 0;
+        std::vector<std::unique_ptr<char[]>> _overflow;
+    };
+
+    //Standard allocator over the arena of the calling thread:
+    template<typename T>
+    struct frame_allocator
+    {
+        using value_type = T;
+
+        frame_allocator() = default;
+
+        template<typename U>
+        frame_allocator( const frame_allocator<U>& )
+        {}
+
+        T* allocate( std::size_t count )
+        {
+            return static_cast<T*>( cpp::frame_arena::local().allocate( count * sizeof( T ) , alignof( T ) ) );
+        }
+
+        void deallocate( T* pointer , std::size_t count )
+        {
+            cpp::frame_arena::local().deallocate( pointer , count * sizeof( T ) );
+        }
+
+        template<typename U>
+        struct rebind
+        {
+            using other = cpp::frame_allocator<U>;
+        };
+    };
+
+    //All the frame allocators are interchangeable (Memory from other arenas is released in its arena, and reused after its next rewind):
+    template<typename T , typename U>
+    bool operator==( const cpp::frame_allocator<T>& , const cpp::frame_allocator<U>& )
+    {
+        return true;
+    }
+
+    template<typename T , typename U>
+    bool operator!=( const cpp::frame_allocator<T>& , const cpp::frame_allocator<U>& )
+    {
+        return false;
+    }
+
+    template<typename T>
+    using frame_vector = std::vector<T,cpp::frame_allocator<T>>;
+}
+
+#endif	/* FRAME_ARENA_HPP */
@@ -14,22 +14,220 @@
 #ifndef POLYMORPHISM_HPP
 #define	POLYMORPHISM_HPP
 
+/* Polymorphic collection with type-segregated storage
+ *
+ * The usual way to store a set of polymorphic objects is a vector of (smart) pointers to the interface. That means
+ * one allocation per object, objects scattered through the heap, and a virtual call per object, with the concrete 
+ * type changing from one element to the next (So the branch predictor and the instruction cache are not happy).
+ * 
+ * cpp::free_polymorphism stores each concrete type in its own segment: A vector with all the objects of that type, 
+ * contiguous and by value. The objects are GENERIC_IMPL<T> instances, where GENERIC_IMPL is the template which adapts
+ * any T to INTERFACE (The "free" polymorphism: T itself doesn't need to inherit from INTERFACE).
+ * 
+ * Iteration goes segment by segment. If the caller names the types it expects (for_each<A,B,C>( f )), the elements of
+ * those segments are passed to f with their concrete type, so the calls are resolved statically (Declare GENERIC_IMPL<T> 
+ * final to be sure the compiler devirtualizes them). The rest of the segments are visited through INTERFACE.
+ * 
+ * For example, given a shape interface and its generic implementation:
+ * 
+ *     cpp::free_polymorphism<shape,shape_impl> shapes;
+ *     
+ *     shapes.insert( circle{ ... } );
+ *     shapes.insert( rectangle{ ... } );
+ *     
+ *     shapes.for_each( []( shape& s ) { s.draw(); } );   //Through shape
+ *
+ * To get the concrete type, pass a function object with an overload for each named type (Plus the INTERFACE one,
+ * for the rest of the segments):
+ *
+ *     struct draw_shape
+ *     {
+ *         void operator()( shape& s ) const { s.draw(); }
+ *         void operator()( shape_impl<circle>& c ) const { c.draw(); } //Circles with their concrete type
+ *     };
+ *
+ *     shapes.for_each<circle>( draw_shape{} );
+ */
+
 #include <vector>
 #include <memory>
+#include <typeindex>
+#include <typeinfo>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
 
 namespace cpp
 {
     template<typename INTERFACE , template<typename> class GENERIC_IMPL>
     class free_polymorphism
     {
+    public:
+        template<typename T>
+        using implementation = GENERIC_IMPL<typename std::decay<T>::type>;
+        
+        template<typename T>
+        void insert( T&& value )
+        {
+            segment<typename std::decay<T>::type>().emplace_back( std::forward<T>( value ) );
+        }
+        
+        template<typename T , typename... ARGS>
+        void emplace( ARGS&&... args )
+        {
+            segment<T>().emplace_back( T{ std::forward<ARGS>( args )... } );
+        }
+        
+        //The segment which stores all the objects of type T (It's created if there's no one yet):
+        template<typename T>
+        std::vector<implementation<T>>& segment()
+        {
+            static_assert( std::is_base_of<INTERFACE,implementation<T>>::value , "GENERIC_IMPL<T> should implement INTERFACE" );
+            
+            auto it = _segments_by_type.find( typeid( T ) );
+            
+            if( it == std::end( _segments_by_type ) )
+            {
+                _segments.emplace_back( new segment_impl<T>{} );
+                it = _segments_by_type.insert( std::make_pair( std::type_index{ typeid( T ) } , _segments.back().get() ) ).first;
+            }
+            
+            return static_cast<segment_impl<T>*>( it->second )->elements;
+        }
+        
+        //Visits all the elements through the interface:
+        template<typename F>
+        void for_each( F f )
+        {
+            for( auto& segment : _segments )
+                visit( *segment , f );
+        }
+        
+        //Visits all the elements, passing the elements of the types TYPES... with their concrete type (GENERIC_IMPL<T>&)
+        //and the rest through the interface:
+        template<typename HEAD , typename... TAIL , typename F>
+        void for_each( F f )
+        {
+            for( auto& segment : _segments )
+                if( !restitution<HEAD,TAIL...>::visit( *segment , f ) )
+                    visit( *segment , f );
+        }
+        
+        std::size_t size() const
+        {
+            std::size_t result = 0;
+            
+            for( auto& segment : _segments )
+                result += segment->size();
+            
+            return result;
+        }
         
+        template<typename T>
+        std::size_t size() const
+        {
+            auto it = _segments_by_type.find( typeid( T ) );
+            
+            return it != std::end( _segments_by_type ) ? it->second->size() : 0u;
+        }
         
+        bool empty() const
+        {
+            return size() == 0u;
+        }
+        
+        void clear()
+        {
+            for( auto& segment : _segments )
+                segment->clear();
+        }
         
     private:
-        std::vector<std::shared_ptr<INTERFACE>> _implementers;
+        struct segment_base
+        {
+            virtual ~segment_base(){}
+            
+            virtual std::type_index type() const = 0;
+            virtual std::size_t size() const = 0;
+            virtual void clear() = 0;
+            
+            //The elements of a segment seen as INTERFACEs: Since all of them have the same type, the i-th one is
+            //at first() + i * stride() bytes.
+            virtual INTERFACE* first() = 0;
+            virtual std::size_t stride() const = 0;
+        };
+        
+        template<typename T>
+        struct segment_impl : public segment_base
+        {
+            std::vector<implementation<T>> elements;
+            
+            std::type_index type() const override
+            {
+                return typeid( T );
+            }
+            
+            std::size_t size() const override
+            {
+                return elements.size();
+            }
+            
+            void clear() override
+            {
+                elements.clear();
+            }
+            
+            INTERFACE* first() override
+            {
+                return elements.empty() ? nullptr : static_cast<INTERFACE*>( elements.data() );
+            }
+            
+            std::size_t stride() const override
+            {
+                return sizeof( implementation<T> );
+            }
+        };
+        
+        template<typename F>
+        static void visit( segment_base& segment , F& f )
+        {
+            char* element = reinterpret_cast<char*>( segment.first() );
+            std::size_t count = segment.size() , stride = segment.stride();
+            
+            for( std::size_t i = 0 ; i < count ; ++i , element += stride )
+                f( *reinterpret_cast<INTERFACE*>( element ) );
+        }
+        
+        //Visits a segment with its concrete type if it's one of TYPES... (The primary template is the end of the list):
+        template<typename... TYPES>
+        struct restitution
+        {
+            template<typename F>
+            static bool visit( segment_base& , F& )
+            {
+                return false;
+            }
+        };
+        
+        template<typename HEAD , typename... TAIL>
+        struct restitution<HEAD,TAIL...>
+        {
+            template<typename F>
+            static bool visit( segment_base& segment , F& f )
+            {
+                if( segment.type() != std::type_index{ typeid( HEAD ) } )
+                    return restitution<TAIL...>::visit( segment , f );
+                
+                for( auto& element : static_cast<segment_impl<HEAD>&>( segment ).elements )
+                    f( element );
+                
+                return true;
+            }
+        };
+        
+        std::vector<std::unique_ptr<segment_base>> _segments; //In insertion order
+        std::unordered_map<std::type_index,segment_base*> _segments_by_type;
     };
-    
-    
 }
 
 #endif	/* POLYMORPHISM_HPP */
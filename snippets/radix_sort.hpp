@@ -0,0 +1,147 @@
+/****************************************************************************
+* Snippets, ejemplos, y utilidades del curso de C++ orientado a videojuegos *
+* https://github.com/Manu343726/CppVideojuegos/                             *
+*                                                                           *
+* Copyright © 2014 Manuel Sánchez Pérez                                     *
+*                                                                           *
+* This program is free software. It comes without any warranty, to          *
+* the extent permitted by applicable law. You can redistribute it           *
+* and/or modify it under the terms of the Do What The Fuck You Want         *
+* To Public License, Version 2, as published by Sam Hocevar. See            *
+* http://www.wtfpl.net/  and the COPYING file for more details.             *
+****************************************************************************/
+
+#ifndef RADIX_SORT_HPP
+#define	RADIX_SORT_HPP
+
+/* Parallel LSD radix sort of 32 bit keys
+ *
+ * Instead of moving the sorted data around, the sort computes a permutation: order[i] is the index (In the
+ * original sequence) of the i-th element of the sorted sequence. That permutation can then be applied to as
+ * many arrays as needed (See apply_permutation()), which is what we want when the data is stored in columns.
+ *
+ * Each pass sorts one byte of the key. The input is split in blocks, each block builds its own histogram in
+ * parallel, the histograms are combined into the destination offsets of each (block,digit) pair, and the
+ * blocks scatter their elements in parallel. Since blocks are ordered and scatter sequentially, each pass
+ * is stable (So the whole sort is). Passes where all the keys share the same digit are skipped.
+ */
+
+#include "thread_pool.hpp"
+#include "frame_arena.hpp"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace cpp
+{
+    //Morton code (Z-order curve): Interleaves the bits of x and y, so points which are close get close keys.
+    //Sorting by this key also groups the points by quadtree cell: The key bits 2n and 2n+1 (From the top) are
+    //the quadrant of the point at the n-th level of the tree.
+    inline std::uint32_t morton_key( std::uint16_t x , std::uint16_t y )
+    {
+        auto spread = []( std::uint32_t v )
+        {
+            v = ( v | ( v << 8 ) ) & 0x00FF00FFu;
+            v = ( v | ( v << 4 ) ) & 0x0F0F0F0Fu;
+            v = ( v | ( v << 2 ) ) & 0x33333333u;
+            v = ( v | ( v << 1 ) ) & 0x55555555u;
+            return v;
+        };
+
+        return spread( x ) | ( spread( y ) << 1 );
+    }
+
+    template<typename KEYS>
+    void parallel_radix_sort( const KEYS& keys , std::vector<std::size_t>& order ,
+                              cpp::thread_pool& pool = cpp::thread_pool::global() )
+    {
+        using histogram = std::array<std::size_t,256>;
+
+        std::size_t count = keys.size();
+        std::size_t blocks = std::max<std::size_t>( 1u , std::min<std::size_t>( pool.size() * 4u , count / 4096u ) );
+
+        //Scratch buffers from the frame arena (order is reused between calls, so in the steady state nothing is allocated):
+        cpp::frame_vector<std::uint32_t> keys_in( std::begin( keys ) , std::end( keys ) ) , keys_out( count );
+        cpp::frame_vector<std::size_t> index_in( count ) , index_out( count );
+        cpp::frame_vector<histogram> histograms( blocks );
+
+        for( std::size_t i = 0 ; i < count ; ++i )
+            index_in[i] = i;
+
+        auto block_begin = [=]( std::size_t block ){ return count * block / blocks; };
+
+        for( std::size_t shift = 0 ; shift < 32 ; shift += 8 )
+        {
+            pool.parallel_for( blocks , 1u , [&]( std::size_t first , std::size_t last )
+            {
+                for( std::size_t block = first ; block < last ; ++block )
+                {
+                    histogram& h = histograms[block];
+                    h.fill( 0u );
+
+                    for( std::size_t i = block_begin( block ) ; i < block_begin( block + 1 ) ; ++i )
+                        h[( keys_in[i] >> shift ) & 0xFFu]++;
+                }
+            });
+
+            //Destination of the first element of each (block,digit) pair. Digit-major, so equal digits keep the block order:
+            std::size_t offset = 0 , used_digits = 0;
+
+            for( std::size_t digit = 0 ; digit < 256 ; ++digit )
+            {
+                std::size_t digit_count = 0;
+
+                for( auto& h : histograms )
+                {
+                    std::size_t block_count = h[digit];
+                    h[digit] = offset;
+                    offset += block_count;
+                    digit_count += block_count;
+                }
+
+                used_digits += digit_count > 0 ? 1u : 0u;
+            }
+
+            //All the keys have the same digit: This pass would not change anything
+            if( used_digits <= 1 )
+                continue;
+
+            pool.parallel_for( blocks , 1u , [&]( std::size_t first , std::size_t last )
+            {
+                for( std::size_t block = first ; block < last ; ++block )
+                {
+                    histogram& h = histograms[block];
+
+                    for( std::size_t i = block_begin( block ) ; i < block_begin( block + 1 ) ; ++i )
+                    {
+                        std::size_t destination = h[( keys_in[i] >> shift ) & 0xFFu]++;
+
+                        keys_out[destination]  = keys_in[i];
+                        index_out[destination] = index_in[i];
+                    }
+                }
+            });
+
+            keys_in.swap( keys_out );
+            index_in.swap( index_out );
+        }
+
+        order.assign( std::begin( index_in ) , std::end( index_in ) );
+    }
+
+    //values[i] = old values[order[i]] (CONTAINER is any vector-like container: std::vector, cpp::arena_vector, etc)
+    template<typename CONTAINER>
+    void apply_permutation( CONTAINER& values , const std::vector<std::size_t>& order )
+    {
+        CONTAINER permuted;
+        permuted.reserve( values.size() );
+
+        for( std::size_t index : order )
+            permuted.push_back( std::move( values[index] ) );
+
+        values.swap( permuted );
+    }
+}
+
+#endif	/* RADIX_SORT_HPP */
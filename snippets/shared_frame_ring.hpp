@@ -0,0 +1,423 @@
+/****************************************************************************
+* Snippets, ejemplos, y utilidades del curso de C++ orientado a videojuegos *
+* https://github.com/Manu343726/CppVideojuegos/                             *
+*                                                                           *
+* Copyright © 2014 Manuel Sánchez Pérez                                     *
+*                                                                           *
+* This program is free software. It comes without any warranty, to          *
+* the extent permitted by applicable law. You can redistribute it           *
+* and/or modify it under the terms of the Do What The Fuck You Want         *
+* To Public License, Version 2, as published by Sam Hocevar. See            *
+* http://www.wtfpl.net/  and the COPYING file for more details.             *
+****************************************************************************/
+
+#ifndef SHARED_FRAME_RING_HPP
+#define	SHARED_FRAME_RING_HPP
+
+/* Ring of particle frames in shared memory, for renderers (Viewers, encoders...) running in another process
+ *
+ * The producer owns a POSIX shared memory segment with a header and slot_count slots. Each slot holds one frame
+ * as columns: x positions, y positions, and RGBA colors, up to capacity particles. The producer writes each new
+ * frame directly into the next slot (See shared_frame_writer::begin_frame()), and publishes it when it's complete.
+ *
+ * Each slot is a seqlock: Its sequence number is odd while the producer is writing it, and increases again when
+ * the frame is published. Readers (See shared_frame_reader) copy the latest published frame out of the segment,
+ * and retry if the sequence number changed meanwhile (The producer lapped them). The producer never waits for the
+ * readers, and there can be any number of them.
+ *
+ * With at least two slots the latest published frame is never the one being written, so readers only retry if
+ * they're slower than a full lap of the ring.
+ *
+ * Segment names follow shm_open() rules ("/name"). Only available on POSIX systems: Elsewhere the constructors
+ * throw std::runtime_error. On Linux, link with -lrt.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined( __unix__ ) || defined( __APPLE__ )
+#define CPP_SHARED_FRAMES_POSIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace cpp
+{
+    struct rgba
+    {
+        std::uint8_t r = 0 , g = 0 , b = 0 , a = 255;
+
+        rgba() = default;
+
+        rgba( std::uint8_t red , std::uint8_t green , std::uint8_t blue , std::uint8_t alpha = 255 ) :
+            r{ red } , g{ green } , b{ blue } , a{ alpha }
+        {}
+    };
+
+    namespace impl
+    {
+        //Layout of the segment. Every block is cache line aligned, so the producer and the readers don't false share.
+        //The atomics have to be lock-free (So they work across processes), which they are on every platform we target.
+        struct shared_frame_header
+        {
+            static const std::uint32_t magic_number = 0x46524D53u; //"SMRF"
+            static const std::uint32_t layout_version = 1u;
+
+            std::uint32_t magic , version;
+            std::uint32_t slot_count , capacity;
+            std::uint64_t slot_bytes;
+            std::atomic<std::uint64_t> published; //Frames published so far. The latest one is in slot (published - 1) % slot_count
+        };
+
+        struct shared_frame_slot
+        {
+            std::atomic<std::uint64_t> sequence; //Odd while the frame is being written
+            std::atomic<std::uint64_t> frame;    //Number of the frame (1 is the first)
+            std::atomic<std::uint32_t> count;
+        };
+
+        static const std::size_t shared_frame_alignment = 64u;
+
+        inline std::size_t shared_frame_round_up( std::size_t bytes )
+        {
+            return ( bytes + shared_frame_alignment - 1u ) / shared_frame_alignment * shared_frame_alignment;
+        }
+
+        //Offsets of the columns inside a slot:
+        struct shared_frame_columns
+        {
+            std::size_t x , y , colors , slot_bytes;
+
+            explicit shared_frame_columns( std::size_t capacity ) :
+                x{ shared_frame_round_up( sizeof( shared_frame_slot ) ) } ,
+                y{ x + shared_frame_round_up( capacity * sizeof( float ) ) } ,
+                colors{ y + shared_frame_round_up( capacity * sizeof( float ) ) } ,
+                slot_bytes{ colors + shared_frame_round_up( capacity * sizeof( cpp::rgba ) ) }
+            {}
+        };
+
+        //The mapping of a segment:
+        class shared_segment
+        {
+        public:
+            shared_segment( const std::string& name , std::size_t bytes , bool create ) :
+                _name{ name } ,
+                _owner{ create }
+            {
+#if defined( CPP_SHARED_FRAMES_POSIX )
+                int descriptor = shm_open( name.c_str() , create ? O_CREAT | O_RDWR : O_RDONLY , 0644 );
+
+                if( descriptor < 0 )
+                    throw std::runtime_error{ "Can't open the shared memory segment " + name };
+
+                struct stat info;
+
+                if( create ? ftruncate( descriptor , static_cast<off_t>( bytes ) ) != 0 : fstat( descriptor , &info ) != 0 )
+                {
+                    close( descriptor );
+                    discard();
+                    throw std::runtime_error{ "Can't size the shared memory segment " + name };
+                }
+
+                _bytes = create ? bytes : static_cast<std::size_t>( info.st_size );
+                _memory = mmap( nullptr , _bytes , create ? PROT_READ | PROT_WRITE : PROT_READ , MAP_SHARED , descriptor , 0 );
+
+                //The mapping keeps the segment alive:
+                close( descriptor );
+
+                if( _memory == MAP_FAILED )
+                {
+                    discard();
+                    throw std::runtime_error{ "Can't map the shared memory segment " + name };
+                }
+#else
+                (void)bytes;
+                throw std::runtime_error{ "Shared memory frames need a POSIX system" };
+#endif
+            }
+
+            shared_segment( const shared_segment& ) = delete;
+            shared_segment& operator=( const shared_segment& ) = delete;
+
+            //The producer removes the name (Readers keep their mappings until they close them):
+            ~shared_segment()
+            {
+#if defined( CPP_SHARED_FRAMES_POSIX )
+                munmap( _memory , _bytes );
+                discard();
+#endif
+            }
+
+            char* data() const
+            {
+                return static_cast<char*>( _memory );
+            }
+
+            std::size_t size() const
+            {
+                return _bytes;
+            }
+
+        private:
+            void discard()
+            {
+#if defined( CPP_SHARED_FRAMES_POSIX )
+                if( _owner )
+                    shm_unlink( _name.c_str() );
+#endif
+            }
+
+            std::string _name;
+            bool _owner;
+            void* _memory = nullptr;
+            std::size_t _bytes = 0;
+        };
+    }
+
+    //A frame being written by the producer: Its columns live in the shared segment, so they're filled in place.
+    class shared_frame
+    {
+    public:
+        float* x() const
+        {
+            return _x;
+        }
+
+        float* y() const
+        {
+            return _y;
+        }
+
+        cpp::rgba* colors() const
+        {
+            return _colors;
+        }
+
+        std::size_t capacity() const
+        {
+            return _capacity;
+        }
+
+        //Particles written so far. When filling the columns directly, set it with resize():
+        std::size_t size() const
+        {
+            return _size;
+        }
+
+        void resize( std::size_t count )
+        {
+            _size = std::min( count , _capacity );
+        }
+
+        //Returns false if the frame is full:
+        bool push_back( float x , float y , const cpp::rgba& color )
+        {
+            if( _size == _capacity )
+                return false;
+
+            _x[_size] = x;
+            _y[_size] = y;
+            _colors[_size] = color;
+            _size++;
+
+            return true;
+        }
+
+    private:
+        friend class shared_frame_writer;
+
+        impl::shared_frame_slot* _slot = nullptr;
+        std::uint64_t _sequence = 0;
+        float* _x = nullptr;
+        float* _y = nullptr;
+        cpp::rgba* _colors = nullptr;
+        std::size_t _capacity = 0 , _size = 0;
+    };
+
+    class shared_frame_writer
+    {
+    public:
+        shared_frame_writer( const std::string& name , std::size_t slot_count , std::size_t capacity ) :
+            _columns{ capacity } ,
+            _segment{ name , impl::shared_frame_round_up( sizeof( impl::shared_frame_header ) ) +
+                             std::max<std::size_t>( slot_count , 2u ) * impl::shared_frame_columns{ capacity }.slot_bytes , true }
+        {
+            std::size_t slots = std::max<std::size_t>( slot_count , 2u );
+
+            //The segment may be a leftover of a previous run: Readers must not trust it until it's initialized again
+            _header = new( _segment.data() ) impl::shared_frame_header;
+            _header->magic = 0u;
+            std::atomic_thread_fence( std::memory_order_release );
+
+            for( std::size_t i = 0 ; i < slots ; ++i )
+            {
+                auto slot = new( _segment.data() + slot_offset( i ) ) impl::shared_frame_slot;
+
+                slot->sequence.store( 0u , std::memory_order_relaxed );
+                slot->frame.store( 0u , std::memory_order_relaxed );
+                slot->count.store( 0u , std::memory_order_relaxed );
+            }
+
+            //The magic number goes last: Readers check it before trusting the rest
+            _header->version    = impl::shared_frame_header::layout_version;
+            _header->slot_count = static_cast<std::uint32_t>( slots );
+            _header->capacity   = static_cast<std::uint32_t>( capacity );
+            _header->slot_bytes = _columns.slot_bytes;
+            _header->published.store( 0u , std::memory_order_relaxed );
+
+            std::atomic_thread_fence( std::memory_order_release );
+            _header->magic = impl::shared_frame_header::magic_number;
+        }
+
+        //The next slot of the ring. Readers skip it until publish() is called:
+        cpp::shared_frame begin_frame()
+        {
+            char* slot_memory = _segment.data() + slot_offset( _published % _header->slot_count );
+
+            cpp::shared_frame frame;
+            frame._slot     = reinterpret_cast<impl::shared_frame_slot*>( slot_memory );
+            frame._sequence = frame._slot->sequence.load( std::memory_order_relaxed ) + 1u;
+            frame._x        = reinterpret_cast<float*>( slot_memory + _columns.x );
+            frame._y        = reinterpret_cast<float*>( slot_memory + _columns.y );
+            frame._colors   = reinterpret_cast<cpp::rgba*>( slot_memory + _columns.colors );
+            frame._capacity = _header->capacity;
+
+            frame._slot->sequence.store( frame._sequence , std::memory_order_relaxed );
+            std::atomic_thread_fence( std::memory_order_release );
+
+            return frame;
+        }
+
+        void publish( const cpp::shared_frame& frame )
+        {
+            frame._slot->count.store( static_cast<std::uint32_t>( frame.size() ) , std::memory_order_relaxed );
+            frame._slot->frame.store( ++_published , std::memory_order_relaxed );
+            frame._slot->sequence.store( frame._sequence + 1u , std::memory_order_release );
+
+            _header->published.store( _published , std::memory_order_release );
+        }
+
+        std::size_t capacity() const
+        {
+            return _header->capacity;
+        }
+
+        std::uint64_t published() const
+        {
+            return _published;
+        }
+
+    private:
+        static std::size_t header_bytes()
+        {
+            return impl::shared_frame_round_up( sizeof( impl::shared_frame_header ) );
+        }
+
+        std::size_t slot_offset( std::size_t slot ) const
+        {
+            return header_bytes() + slot * _columns.slot_bytes;
+        }
+
+        impl::shared_frame_columns _columns;
+        impl::shared_segment _segment;
+        impl::shared_frame_header* _header = nullptr;
+        std::uint64_t _published = 0;
+    };
+
+    //A frame copied out of the ring:
+    struct shared_frame_snapshot
+    {
+        std::uint64_t frame = 0; //0 if nothing has been read yet
+        std::vector<float> x , y;
+        std::vector<cpp::rgba> colors;
+
+        std::size_t size() const
+        {
+            return x.size();
+        }
+    };
+
+    class shared_frame_reader
+    {
+    public:
+        explicit shared_frame_reader( const std::string& name ) :
+            _segment{ name , 0u , false }
+        {
+            _header = reinterpret_cast<const impl::shared_frame_header*>( _segment.data() );
+
+            if( _segment.size() < sizeof( impl::shared_frame_header ) ||
+                _header->magic != impl::shared_frame_header::magic_number ||
+                _header->version != impl::shared_frame_header::layout_version )
+                throw std::runtime_error{ "Not a frame ring: " + name };
+
+            std::atomic_thread_fence( std::memory_order_acquire );
+
+            _columns = impl::shared_frame_columns{ _header->capacity };
+
+            if( _segment.size() < impl::shared_frame_round_up( sizeof( impl::shared_frame_header ) ) + _header->slot_count * _columns.slot_bytes )
+                throw std::runtime_error{ "Truncated frame ring: " + name };
+        }
+
+        //Copies the latest published frame into snapshot. Returns false if there's nothing newer than what the snapshot
+        //already has. Never blocks the producer: A frame overwritten while being copied is just read again.
+        bool read_latest( cpp::shared_frame_snapshot& snapshot ) const
+        {
+            for( ;; )
+            {
+                std::uint64_t published = _header->published.load( std::memory_order_acquire );
+
+                if( published == 0 || published == snapshot.frame )
+                    return false;
+
+                const char* slot_memory = _segment.data() + impl::shared_frame_round_up( sizeof( impl::shared_frame_header ) ) +
+                                          ( published - 1u ) % _header->slot_count * _columns.slot_bytes;
+                auto slot = reinterpret_cast<const impl::shared_frame_slot*>( slot_memory );
+
+                std::uint64_t sequence = slot->sequence.load( std::memory_order_acquire );
+
+                if( sequence % 2u != 0 )
+                    continue;
+
+                std::uint64_t frame = slot->frame.load( std::memory_order_relaxed );
+                std::size_t count   = std::min<std::size_t>( slot->count.load( std::memory_order_relaxed ) , _header->capacity );
+
+                snapshot.x.resize( count );
+                snapshot.y.resize( count );
+                snapshot.colors.resize( count );
+
+                std::memcpy( snapshot.x.data()      , slot_memory + _columns.x      , count * sizeof( float ) );
+                std::memcpy( snapshot.y.data()      , slot_memory + _columns.y      , count * sizeof( float ) );
+                std::memcpy( snapshot.colors.data() , slot_memory + _columns.colors , count * sizeof( cpp::rgba ) );
+
+                std::atomic_thread_fence( std::memory_order_acquire );
+
+                if( slot->sequence.load( std::memory_order_relaxed ) != sequence )
+                    continue;
+
+                snapshot.frame = frame;
+                return true;
+            }
+        }
+
+        std::size_t capacity() const
+        {
+            return _header->capacity;
+        }
+
+    private:
+        impl::shared_segment _segment;
+        const impl::shared_frame_header* _header = nullptr;
+        impl::shared_frame_columns _columns{ 0u };
+    };
+}
+
+#endif	/* SHARED_FRAME_RING_HPP */
@@ -0,0 +1,300 @@
+/****************************************************************************
+* Snippets, ejemplos, y utilidades del curso de C++ orientado a videojuegos *
+* https://github.com/Manu343726/CppVideojuegos/                             *
+*                                                                           *
+* Copyright © 2014 Manuel Sánchez Pérez                                     *
+*                                                                           *
+* This program is free software. It comes without any warranty, to          *
+* the extent permitted by applicable law. You can redistribute it           *
+* and/or modify it under the terms of the Do What The Fuck You Want         *
+* To Public License, Version 2, as published by Sam Hocevar. See            *
+* http://www.wtfpl.net/  and the COPYING file for more details.             *
+****************************************************************************/
+
+#ifndef SLOT_MAP_HPP
+#define	SLOT_MAP_HPP
+
+/* Slot map: Dense storage with stable, generational handles
+ *
+ * The elements live contiguously (So iterating them is just walking an array), and can be moved around freely:
+ * Erasing swaps the last element into the hole, and the whole sequence can be permuted (See permute()). External
+ * code refers to elements through handles instead of positions. A handle is the index of a slot, which stores the
+ * current position of the element, plus the generation of the slot: Each time a slot is freed its generation is
+ * bumped, so handles to erased elements are detected (contains() returns false) even after the slot is reused.
+ *
+ * Insertion, erasure and lookup are O(1). handle_table is the bookkeeping alone, for containers which store their
+ * elements in several columns (It only tracks positions), and slot_map puts it together with a std::vector.
+ */
+
+#include "radix_sort.hpp"
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace cpp
+{
+    struct slot_handle
+    {
+        static const std::uint32_t null_index = 0xFFFFFFFFu;
+
+        std::uint32_t index      = null_index;
+        std::uint32_t generation = 0;
+
+        slot_handle() = default;
+
+        slot_handle( std::uint32_t slot , std::uint32_t slot_generation ) :
+            index{ slot } ,
+            generation{ slot_generation }
+        {}
+
+        //A default constructed handle refers to nothing:
+        explicit operator bool() const
+        {
+            return index != null_index;
+        }
+
+        friend bool operator==( const slot_handle& lhs , const slot_handle& rhs )
+        {
+            return lhs.index == rhs.index && lhs.generation == rhs.generation;
+        }
+
+        friend bool operator!=( const slot_handle& lhs , const slot_handle& rhs )
+        {
+            return !( lhs == rhs );
+        }
+    };
+
+    class handle_table
+    {
+    public:
+        using handle = cpp::slot_handle;
+
+        void reserve( std::size_t count )
+        {
+            _slots.reserve( count );
+            _owners.reserve( count );
+        }
+
+        std::size_t size() const
+        {
+            return _owners.size();
+        }
+
+        //The new element goes at the end (Position size() - 1):
+        handle insert()
+        {
+            std::uint32_t slot;
+
+            if( _free != handle::null_index )
+            {
+                slot  = _free;
+                _free = _slots[slot].position;
+            }
+            else
+            {
+                slot = static_cast<std::uint32_t>( _slots.size() );
+                _slots.push_back( entry{} );
+            }
+
+            _slots[slot].position = static_cast<std::uint32_t>( _owners.size() );
+            _owners.push_back( slot );
+
+            return handle{ slot , _slots[slot].generation };
+        }
+
+        bool contains( const handle& h ) const
+        {
+            return h.index < _slots.size() && _slots[h.index].generation == h.generation;
+        }
+
+        //Position of the element (The handle must be valid):
+        std::size_t index( const handle& h ) const
+        {
+            return _slots[h.index].position;
+        }
+
+        handle handle_of( std::size_t position ) const
+        {
+            std::uint32_t slot = _owners[position];
+
+            return handle{ slot , _slots[slot].generation };
+        }
+
+        //Erases the element at position, moving the last one into its place (Containers have to do the same with their values):
+        void erase_at( std::size_t position )
+        {
+            std::uint32_t slot = _owners[position] , last = _owners.back();
+
+            _owners[position]     = last;
+            _slots[last].position = static_cast<std::uint32_t>( position );
+            _owners.pop_back();
+
+            _slots[slot].generation++;
+            _slots[slot].position = _free;
+            _free = slot;
+        }
+
+        //The elements have been reordered: The i-th element is the old order[i]-th (Same as apply_permutation())
+        void permute( const std::vector<std::size_t>& order )
+        {
+            cpp::apply_permutation( _owners , order );
+
+            for( std::size_t i = 0 ; i < _owners.size() ; ++i )
+                _slots[_owners[i]].position = static_cast<std::uint32_t>( i );
+        }
+
+        //Invalidates all the handles:
+        void clear()
+        {
+            while( !_owners.empty() )
+                erase_at( _owners.size() - 1 );
+        }
+
+    private:
+        struct entry
+        {
+            std::uint32_t position   = 0; //Position of the element, or next free slot if the slot is free
+            std::uint32_t generation = 0;
+        };
+
+        std::vector<entry> _slots;
+        std::vector<std::uint32_t> _owners; //Slot of the element at each position
+        std::uint32_t _free = handle::null_index;
+    };
+
+    template<typename T>
+    class slot_map
+    {
+    public:
+        using handle         = cpp::slot_handle;
+        using value_type     = T;
+        using iterator       = typename std::vector<T>::iterator;
+        using const_iterator = typename std::vector<T>::const_iterator;
+
+        void reserve( std::size_t count )
+        {
+            _handles.reserve( count );
+            _values.reserve( count );
+        }
+
+        template<typename... ARGS>
+        handle emplace( ARGS&&... args )
+        {
+            _values.emplace_back( std::forward<ARGS>( args )... );
+
+            return _handles.insert();
+        }
+
+        handle insert( const T& value )
+        {
+            return emplace( value );
+        }
+
+        //Returns false if the element was already erased:
+        bool erase( const handle& h )
+        {
+            if( !contains( h ) )
+                return false;
+
+            erase_at( _handles.index( h ) );
+            return true;
+        }
+
+        //Erases the element at position, moving the last one into its place:
+        void erase_at( std::size_t position )
+        {
+            _handles.erase_at( position );
+
+            if( position + 1 != _values.size() )
+                _values[position] = std::move( _values.back() );
+
+            _values.pop_back();
+        }
+
+        bool contains( const handle& h ) const
+        {
+            return _handles.contains( h );
+        }
+
+        //nullptr if the element was erased:
+        T* find( const handle& h )
+        {
+            return contains( h ) ? &_values[_handles.index( h )] : nullptr;
+        }
+
+        const T* find( const handle& h ) const
+        {
+            return contains( h ) ? &_values[_handles.index( h )] : nullptr;
+        }
+
+        //Unchecked lookup:
+        T& operator[]( const handle& h )
+        {
+            return _values[_handles.index( h )];
+        }
+
+        const T& operator[]( const handle& h ) const
+        {
+            return _values[_handles.index( h )];
+        }
+
+        handle handle_of( std::size_t position ) const
+        {
+            return _handles.handle_of( position );
+        }
+
+        std::size_t index_of( const handle& h ) const
+        {
+            return _handles.index( h );
+        }
+
+        void permute( const std::vector<std::size_t>& order )
+        {
+            cpp::apply_permutation( _values , order );
+            _handles.permute( order );
+        }
+
+        void clear()
+        {
+            _handles.clear();
+            _values.clear();
+        }
+
+        std::size_t size() const
+        {
+            return _values.size();
+        }
+
+        bool empty() const
+        {
+            return _values.empty();
+        }
+
+        iterator begin()
+        {
+            return std::begin( _values );
+        }
+
+        iterator end()
+        {
+            return std::end( _values );
+        }
+
+        const_iterator begin() const
+        {
+            return std::begin( _values );
+        }
+
+        const_iterator end() const
+        {
+            return std::end( _values );
+        }
+
+    private:
+        cpp::handle_table _handles;
+        std::vector<T> _values;
+    };
+}
+
+#endif	/* SLOT_MAP_HPP */
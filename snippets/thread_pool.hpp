@@ -0,0 +1,191 @@
+/****************************************************************************
+* Snippets, ejemplos, y utilidades del curso de C++ orientado a videojuegos *
+* https://github.com/Manu343726/CppVideojuegos/                             *
+*                                                                           *
+* Copyright © 2014 Manuel Sánchez Pérez                                     *
+*                                                                           *
+* This program is free software. It comes without any warranty, to          *
+* the extent permitted by applicable law. You can redistribute it           *
+* and/or modify it under the terms of the Do What The Fuck You Want         *
+* To Public License, Version 2, as published by Sam Hocevar. See            *
+* http://www.wtfpl.net/  and the COPYING file for more details.             *
+****************************************************************************/
+
+#ifndef THREAD_POOL_HPP
+#define	THREAD_POOL_HPP
+
+/* A minimal fork-join thread pool for data-parallel loops
+ *
+ * The workers are created once and sleep between jobs, so a parallel loop per frame doesn't pay for thread
+ * creation. The calling thread works too (It's worker 0), and parallel_for() doesn't return until the whole
+ * range has been processed.
+ *
+ * The range is split in blocks of grain elements, which the workers pick dynamically. The function is called
+ * as f( begin , end ) once per block:
+ *
+ *     cpp::thread_pool::global().parallel_for( particles.size() , 1024u , [&]( std::size_t begin , std::size_t end )
+ *     {
+ *         for( std::size_t i = begin ; i < end ; ++i )
+ *             ...
+ *     });
+ *
+ * Jobs are not reentrant: Don't call parallel_for() from inside a parallel_for().
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace cpp
+{
+    class thread_pool
+    {
+    public:
+        explicit thread_pool( std::size_t threads = std::thread::hardware_concurrency() ) :
+            _job_id{ 0 } ,
+            _running{ 0 } ,
+            _exit{ false }
+        {
+            for( std::size_t i = 1 ; i < threads ; ++i )
+                _workers.emplace_back( &thread_pool::worker_loop , this , i );
+        }
+
+        thread_pool( const thread_pool& ) = delete;
+        thread_pool& operator=( const thread_pool& ) = delete;
+
+        ~thread_pool()
+        {
+            {
+                std::lock_guard<std::mutex> lock{ _mutex };
+                _exit = true;
+            }
+
+            _wake_up.notify_all();
+
+            for( auto& worker : _workers )
+                worker.join();
+        }
+
+        //Number of threads which run the jobs (Including the caller):
+        std::size_t size() const
+        {
+            return _workers.size() + 1;
+        }
+
+        //Index of the current thread inside the pool (0 is the thread which called parallel_for()):
+        static std::size_t worker_index()
+        {
+            return current_worker();
+        }
+
+        template<typename F>
+        void parallel_for( std::size_t count , std::size_t grain , F f )
+        {
+            if( grain == 0 ) grain = 1;
+
+            //Not worth waking up anybody:
+            if( count <= grain || _workers.empty() )
+            {
+                if( count > 0 ) f( std::size_t{ 0 } , count );
+                return;
+            }
+
+            //The job captures a single pointer, so the std::function stores it inline (No allocation per loop):
+            struct loop
+            {
+                std::atomic<std::size_t> next;
+                std::size_t count , grain;
+                F& f;
+            } state{ { 0 } , count , grain , f };
+
+            loop* job = &state;
+
+            run( [job]( std::size_t )
+            {
+                for( std::size_t begin = job->next.fetch_add( job->grain ) ; begin < job->count ; begin = job->next.fetch_add( job->grain ) )
+                    job->f( begin , std::min( begin + job->grain , job->count ) );
+            });
+        }
+
+        //Runs f( worker_index ) once on each thread of the pool:
+        void run( const std::function<void(std::size_t)>& f )
+        {
+            {
+                std::lock_guard<std::mutex> lock{ _mutex };
+
+                _job = &f;
+                _running = _workers.size();
+                _job_id++;
+            }
+
+            _wake_up.notify_all();
+
+            f( 0 );
+
+            std::unique_lock<std::mutex> lock{ _mutex };
+            _job_done.wait( lock , [this]{ return _running == 0; } );
+            _job = nullptr;
+        }
+
+        static thread_pool& global()
+        {
+            static thread_pool pool;
+
+            return pool;
+        }
+
+    private:
+        static std::size_t& current_worker()
+        {
+            static thread_local std::size_t index = 0;
+
+            return index;
+        }
+
+        void worker_loop( std::size_t index )
+        {
+            current_worker() = index;
+
+            std::size_t last_job = 0;
+
+            while( true )
+            {
+                const std::function<void(std::size_t)>* job;
+
+                {
+                    std::unique_lock<std::mutex> lock{ _mutex };
+                    _wake_up.wait( lock , [&]{ return _exit || _job_id != last_job; } );
+
+                    if( _exit ) return;
+
+                    job = _job;
+                    last_job = _job_id;
+                }
+
+                (*job)( index );
+
+                std::lock_guard<std::mutex> lock{ _mutex };
+
+                if( --_running == 0 )
+                    _job_done.notify_one();
+            }
+        }
+
+        std::vector<std::thread> _workers;
+
+        std::mutex _mutex;
+        std::condition_variable _wake_up , _job_done;
+
+        const std::function<void(std::size_t)>* _job = nullptr;
+        std::size_t _job_id;
+        std::size_t _running;
+        bool _exit;
+    };
+}
+
+#endif	/* THREAD_POOL_HPP */